@@ -11,9 +11,24 @@ check_compilation(){
 
 if [ -z "$1" ]; then
     echo "Compiling and running src/main.cpp..."
-    g++ -o main  src/main.cpp -lGL -lGLU -lglut
+    g++ -O3 -march=native -pthread -o main src/main.cpp -lGL -lGLU -lglut -ldl
     check_compilation
     ./main
+elif [ "$1" == "headless" ]; then
+    echo "Compiling src/main.cpp and running it without a window..."
+    g++ -O3 -march=native -pthread -o main src/main.cpp -lGL -lGLU -lglut -ldl
+    check_compilation
+    ./main --headless "${2:-Data/data.txt}" "${@:3}"
+elif [ "$1" == "benchmark" ]; then
+    echo "Compiling src/main.cpp and running the benchmarks..."
+    g++ -O3 -march=native -pthread -o main src/main.cpp -lGL -lGLU -lglut -ldl
+    check_compilation
+    ./main --benchmark "${@:2}"
+elif [ "$1" == "ensemble" ]; then
+    echo "Compiling src/main.cpp and running an ensemble..."
+    g++ -O3 -march=native -pthread -o main src/main.cpp -lGL -lGLU -lglut -ldl
+    check_compilation
+    ./main --ensemble="${2:-Data/moon-ensemble.txt}" "${@:3}"
 elif [ "$1" == "format" ]; then
     find . -iname *.hpp -o -iname *.cpp | xargs clang-format -i
 else
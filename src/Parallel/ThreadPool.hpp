@@ -0,0 +1,185 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Function run for every chunk [begin, end) of a parallel loop. The worker
+// index lets the function use per-worker scratch buffers
+typedef std::function<void(size_t begin, size_t end, unsigned int worker)>
+    ChunkFunction;
+
+// Define a structure for the chunks queued to one worker. The owner takes
+// chunks from the front, and idle workers steal them from the back
+struct WorkerQueue {
+  std::mutex mutex;
+  size_t front = 0, back = 0; // range of chunk indices still queued
+};
+
+// Define a persistent pool of worker threads that run parallel loops. The
+// calling thread takes part in every loop as worker 0, so a pool of one
+// thread runs everything inline
+struct ThreadPool {
+  std::vector<std::thread> threads;
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  std::mutex mutex;
+  std::condition_variable wakeUp, finished;
+  unsigned long generation = 0; // increased for every loop
+  unsigned int running = 0;     // workers still inside the current loop
+  bool stopping = false;
+
+  // Description of the current loop
+  const ChunkFunction *function = nullptr;
+  size_t begin = 0, end = 0, chunkSize = 1;
+
+  ~ThreadPool();
+};
+
+// Function to take a chunk from a queue, from its front for the owner and
+// from its back for thieves
+bool takeChunk(WorkerQueue &queue, bool owner, size_t &chunk) {
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.front == queue.back) {
+    return false;
+  }
+  chunk = owner ? queue.front++ : --queue.back;
+  return true;
+}
+
+// Function to run chunks of the current loop until none is left, first from
+// the worker's own queue and then stolen from the others
+void runChunks(ThreadPool &pool, unsigned int worker) {
+  unsigned int workers = pool.queues.size();
+  size_t chunk;
+
+  for (unsigned int k = 0; k < workers; k++) {
+    unsigned int victim = (worker + k) % workers;
+    while (takeChunk(*pool.queues[victim], k == 0, chunk)) {
+      size_t chunkBegin = pool.begin + chunk * pool.chunkSize;
+      size_t chunkEnd = std::min(chunkBegin + pool.chunkSize, pool.end);
+      (*pool.function)(chunkBegin, chunkEnd, worker);
+    }
+  }
+}
+
+// Main loop of the pool threads, which sleep between loops
+void workerLoop(ThreadPool &pool, unsigned int worker) {
+  unsigned long seenGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(pool.mutex);
+      pool.wakeUp.wait(lock, [&] {
+        return pool.stopping || pool.generation != seenGeneration;
+      });
+      if (pool.stopping) {
+        return;
+      }
+      seenGeneration = pool.generation;
+    }
+
+    runChunks(pool, worker);
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (--pool.running == 0) {
+      pool.finished.notify_one();
+    }
+  }
+}
+
+// Function to start the pool threads. The total number of workers, counting
+// the calling thread, is given by threadCount (0 picks one per core)
+void startThreadPool(ThreadPool &pool, unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (unsigned int i = 0; i < threadCount; i++) {
+    pool.queues.emplace_back(new WorkerQueue());
+  }
+  for (unsigned int i = 1; i < threadCount; i++) {
+    pool.threads.emplace_back(workerLoop, std::ref(pool), i);
+  }
+}
+
+// Function to stop and join the pool threads
+void stopThreadPool(ThreadPool &pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.stopping = true;
+  }
+  pool.wakeUp.notify_all();
+  for (std::thread &thread : pool.threads) {
+    thread.join();
+  }
+  pool.threads.clear();
+}
+
+ThreadPool::~ThreadPool() { stopThreadPool(*this); }
+
+// Function to get the number of workers of the pool
+unsigned int workerCount(const ThreadPool &pool) {
+  return std::max<size_t>(1, pool.queues.size());
+}
+
+// Function to run a function over [begin, end) split in chunks of at most
+// chunkSize indices. Each worker starts with a contiguous block of chunks and
+// steals from the others when it runs out. Which worker runs a chunk is not
+// fixed, and the chunk sizes callers get from chunkSizeFor change with the
+// number of workers, so the results only stay the same for any number of
+// threads if the function works on each index on its own. Anything summed
+// over a chunk would be summed in a different order
+void parallelFor(ThreadPool &pool, size_t begin, size_t end, size_t chunkSize,
+                 const ChunkFunction &function) {
+  if (begin >= end) {
+    return;
+  }
+  chunkSize = std::max<size_t>(1, chunkSize);
+  size_t chunks = (end - begin + chunkSize - 1) / chunkSize;
+  unsigned int workers = pool.queues.size();
+
+  if (workers <= 1 || chunks == 1) {
+    for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize) {
+      function(chunkBegin, std::min(chunkBegin + chunkSize, end), 0);
+    }
+    return;
+  }
+
+  pool.function = &function;
+  pool.begin = begin;
+  pool.end = end;
+  pool.chunkSize = chunkSize;
+  for (unsigned int i = 0; i < workers; i++) {
+    WorkerQueue &queue = *pool.queues[i];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.front = chunks * i / workers;
+    queue.back = chunks * (i + 1) / workers;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.generation++;
+    pool.running = workers - 1;
+  }
+  pool.wakeUp.notify_all();
+
+  runChunks(pool, 0);
+
+  // Wait for the other workers to leave the loop, so the next one can reuse
+  // the queues safely
+  std::unique_lock<std::mutex> lock(pool.mutex);
+  pool.finished.wait(lock, [&] { return pool.running == 0; });
+}
+
+// Function to pick a chunk size giving every worker several chunks, so
+// stealing can balance uneven work
+size_t chunkSizeFor(const ThreadPool &pool, size_t count, size_t minimum) {
+  return std::max(minimum, count / (workerCount(pool) * 8) + 1);
+}
+
+#endif
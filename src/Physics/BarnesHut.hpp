@@ -0,0 +1,524 @@
+#ifndef BARNES_HUT_HPP
+#define BARNES_HUT_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "BodySystem.hpp"
+#include "Gravity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Bits per axis of the Morton keys, which is also the maximum tree depth
+const int treeLevels = 16;
+// Maximum number of bodies kept in a leaf of the tree
+const unsigned int treeLeafSize = 16;
+// Bits of the keys sorted by each pass of the radix sort, which must divide
+// 3 * treeLevels
+const int radixBits = 8;
+// Bodies handed to a worker at a time by the passes of the tree build
+const size_t treeBlockSize = 1 << 14;
+// Level of the nodes below which the parts of the tree are built in
+// parallel, which gives up to 8^treeSplitLevel parts
+const int treeSplitLevel = 3;
+
+// Define a structure for representing a cubic cell of the octree
+struct TreeNode {
+  double comX, comY, comZ, mass; // center of mass and total mass of the cell
+  double minX, minY, minZ, size; // lower corner and side of the cell
+  unsigned int begin, end;       // range of the cell bodies in sorted order
+  int firstChild;                // index of the first child, or -1 for leaves
+  int childCount;
+};
+
+// Define a structure for holding the masses a group of bodies interacts
+// with: whole cells far enough away, and single bodies of the nearby leaves
+struct InteractionList {
+  size_t count = 0; // masses in the list, which its arrays only ever outgrow
+  BodyArray x, y, z, mass;
+  std::vector<int> stack;
+};
+
+// Define a structure for holding the nodes of a part of the tree, built on
+// its own from its first node, and the leaves among them
+struct TreeBuild {
+  std::vector<TreeNode> nodes;
+  std::vector<int> leaves;
+  int level = 0;         // level of the first node
+  int root = 0;          // index of the first node in the tree
+  int offset = 0;        // added to the indices of the others in the tree
+  size_t leafOffset = 0; // position of the first leaf in the tree
+};
+
+// Define a structure for holding the octree and the buffers used to build
+// it, which are kept between steps to avoid reallocating them
+struct Octree {
+  std::vector<TreeNode> nodes;
+  std::vector<int> leaves;
+  std::vector<uint64_t> keys, sortedKeys;
+  std::vector<unsigned int> order, sortedOrder;
+  std::vector<size_t> offsets; // buckets of every block of the radix sort
+  std::vector<double> bounds;  // lowest and highest x, y, z of every block
+  std::vector<TreeBuild> subtrees; // parts below treeSplitLevel, kept too
+  size_t subtreeCount = 0;         // parts of the current tree
+  BodyArray x, y, z, mass; // body data in the sorted order
+  std::vector<InteractionList> lists; // one per worker of the thread pool
+};
+
+// Function to spread the lower 16 bits of a number to every third bit
+uint64_t spreadBits(uint64_t v) {
+  v &= 0xffff;
+  v = (v | (v << 32)) & 0x001f00000000ffffull;
+  v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+  v = (v | (v << 8)) & 0x100f00f00f00f00full;
+  v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+  v = (v | (v << 2)) & 0x1249249249249249ull;
+  return v;
+}
+
+// Function to get the number of blocks of treeBlockSize bodies the passes of
+// the tree build share among the workers
+size_t treeBlocks(size_t count) {
+  return (count + treeBlockSize - 1) / treeBlockSize;
+}
+
+// Function to sort the bodies by Morton key with a radix sort, which runs in
+// linear time and keeps the buffers of the tree. Only the 3 * treeLevels
+// bits the keys use are sorted. In every pass, each block of bodies counts
+// its buckets and then scatters its keys on its own, after the keys of the
+// same bucket in the blocks before it. The sort is stable, so the order is
+// the same for any number of workers
+void sortByKey(Octree &tree, size_t count, ThreadPool &pool) {
+  const int passes = 3 * treeLevels / radixBits;
+  const size_t buckets = size_t(1) << radixBits;
+  size_t blocks = treeBlocks(count);
+  tree.sortedKeys.resize(count);
+  tree.sortedOrder.resize(count);
+  tree.offsets.resize(blocks * buckets);
+
+  for (int pass = 0; pass < passes; pass++) {
+    int shift = pass * radixBits;
+    parallelFor(pool, 0, blocks, 1,
+                [&](size_t firstBlock, size_t lastBlock, unsigned int) {
+                  for (size_t block = firstBlock; block < lastBlock;
+                       block++) {
+                    size_t *offsets = tree.offsets.data() + block * buckets;
+                    std::fill(offsets, offsets + buckets, 0);
+                    size_t end = std::min(count, (block + 1) * treeBlockSize);
+                    for (size_t i = block * treeBlockSize; i < end; i++) {
+                      offsets[(tree.keys[i] >> shift) & (buckets - 1)]++;
+                    }
+                  }
+                });
+
+    size_t total = 0;
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+      for (size_t block = 0; block < blocks; block++) {
+        size_t &offset = tree.offsets[block * buckets + bucket];
+        size_t bucketSize = offset;
+        offset = total;
+        total += bucketSize;
+      }
+    }
+
+    parallelFor(pool, 0, blocks, 1,
+                [&](size_t firstBlock, size_t lastBlock, unsigned int) {
+                  for (size_t block = firstBlock; block < lastBlock;
+                       block++) {
+                    size_t *offsets = tree.offsets.data() + block * buckets;
+                    size_t end = std::min(count, (block + 1) * treeBlockSize);
+                    for (size_t i = block * treeBlockSize; i < end; i++) {
+                      size_t position =
+                          offsets[(tree.keys[i] >> shift) & (buckets - 1)]++;
+                      tree.sortedKeys[position] = tree.keys[i];
+                      tree.sortedOrder[position] = tree.order[i];
+                    }
+                  }
+                });
+    tree.keys.swap(tree.sortedKeys);
+    tree.order.swap(tree.sortedOrder);
+  }
+}
+
+// Function to tell whether a node of the given level is a leaf
+bool isLeaf(const TreeNode &node, int level) {
+  return node.end - node.begin <= treeLeafSize || level == treeLevels;
+}
+
+// Function to add the nonempty octants of a node at the end of a list of
+// nodes, in the order of their keys, and return how many there are. The
+// bodies of the node share the first 3 * level bits of their keys
+int splitNode(const Octree &tree, std::vector<TreeNode> &nodes, int index,
+              int level) {
+  TreeNode node = nodes[index];
+  unsigned int begin = node.begin, end = node.end;
+
+  // The eight octants are contiguous in the sorted order
+  int shift = 3 * (treeLevels - level - 1);
+  uint64_t prefix = tree.keys[begin] >> (shift + 3) << (shift + 3);
+  unsigned int bounds[9] = {begin, 0, 0, 0, 0, 0, 0, 0, end};
+  for (uint64_t octant = 1; octant < 8; octant++) {
+    bounds[octant] =
+        std::lower_bound(tree.keys.begin() + begin, tree.keys.begin() + end,
+                         prefix | (octant << shift)) -
+        tree.keys.begin();
+  }
+
+  double half = node.size / 2;
+  int childCount = 0;
+  for (int octant = 0; octant < 8; octant++) {
+    if (bounds[octant] < bounds[octant + 1]) {
+      TreeNode child;
+      // Key bits come from x, y and z in turn
+      child.minX = node.minX + (octant & 1 ? half : 0);
+      child.minY = node.minY + (octant & 2 ? half : 0);
+      child.minZ = node.minZ + (octant & 4 ? half : 0);
+      child.size = half;
+      child.begin = bounds[octant];
+      child.end = bounds[octant + 1];
+      nodes.push_back(child);
+      childCount++;
+    }
+  }
+  return childCount;
+}
+
+// Function to give a node its children and the mass of their bodies.
+// Massless cells keep their geometric center
+void setNodeMass(TreeNode &node, int firstChild, int childCount, double mass,
+                 double mx, double my, double mz) {
+  node.firstChild = firstChild;
+  node.childCount = childCount;
+  node.mass = mass;
+  node.comX = mass > 0 ? mx / mass : node.minX + node.size / 2;
+  node.comY = mass > 0 ? my / mass : node.minY + node.size / 2;
+  node.comZ = mass > 0 ? mz / mass : node.minZ + node.size / 2;
+}
+
+// Function to sum the mass of the children of a node, in their order
+void sumChildren(std::vector<TreeNode> &nodes, int index, int firstChild,
+                 int childCount) {
+  double mass = 0, mx = 0, my = 0, mz = 0;
+  for (int child = firstChild; child < firstChild + childCount; child++) {
+    const TreeNode &built = nodes[child];
+    mass += built.mass;
+    mx += built.mass * built.comX;
+    my += built.mass * built.comY;
+    mz += built.mass * built.comZ;
+  }
+  setNodeMass(nodes[index], firstChild, childCount, mass, mx, my, mz);
+}
+
+// Function to fill a node of a part of the tree and, recursively, its
+// children
+void buildNode(const Octree &tree, TreeBuild &build, int index, int level) {
+  TreeNode &node = build.nodes[index];
+
+  if (isLeaf(node, level)) {
+    double mass = 0, mx = 0, my = 0, mz = 0;
+    for (unsigned int i = node.begin; i < node.end; i++) {
+      mass += tree.mass[i];
+      mx += tree.mass[i] * tree.x[i];
+      my += tree.mass[i] * tree.y[i];
+      mz += tree.mass[i] * tree.z[i];
+    }
+    setNodeMass(node, -1, 0, mass, mx, my, mz);
+    build.leaves.push_back(index);
+    return;
+  }
+
+  // The nodes vector may grow, so the node is only used by index from here
+  int firstChild = build.nodes.size();
+  int childCount = splitNode(tree, build.nodes, index, level);
+  for (int child = firstChild; child < firstChild + childCount; child++) {
+    buildNode(tree, build, child, level + 1);
+  }
+  sumChildren(build.nodes, index, firstChild, childCount);
+}
+
+// Function to split the top levels of the tree, above treeSplitLevel, and
+// queue the nodes below them as parts to build on their own, in the order
+// the tree is walked
+void splitTop(Octree &tree, int index, int level) {
+  if (level == treeSplitLevel || isLeaf(tree.nodes[index], level)) {
+    if (tree.subtreeCount == tree.subtrees.size()) {
+      tree.subtrees.emplace_back();
+    }
+    TreeBuild &subtree = tree.subtrees[tree.subtreeCount++];
+    subtree.nodes.assign(1, tree.nodes[index]);
+    subtree.leaves.clear();
+    subtree.level = level;
+    return;
+  }
+  int firstChild = tree.nodes.size();
+  int childCount = splitNode(tree, tree.nodes, index, level);
+  for (int child = firstChild; child < firstChild + childCount; child++) {
+    splitTop(tree, child, level + 1);
+  }
+}
+
+// Function to lay the top levels of the tree out again, and make room for
+// the parts built below them after the nodes of the tree as they come in the
+// walk. Once the parts are copied there, the tree is the same as one built
+// in a single walk
+void joinTop(Octree &tree, int index, int level, size_t &next) {
+  if (level == treeSplitLevel || isLeaf(tree.nodes[index], level)) {
+    TreeBuild &subtree = tree.subtrees[next++];
+    // The first node of the part is the one already in the tree
+    subtree.root = index;
+    subtree.offset = tree.nodes.size() - 1;
+    subtree.leafOffset = tree.leaves.size();
+    tree.nodes[index] = subtree.nodes[0];
+    if (subtree.nodes[0].firstChild >= 0) {
+      tree.nodes[index].firstChild += subtree.offset;
+    }
+    tree.nodes.resize(tree.nodes.size() + subtree.nodes.size() - 1);
+    tree.leaves.resize(tree.leaves.size() + subtree.leaves.size());
+    return;
+  }
+  int firstChild = tree.nodes.size();
+  int childCount = splitNode(tree, tree.nodes, index, level);
+  for (int child = firstChild; child < firstChild + childCount; child++) {
+    joinTop(tree, child, level + 1, next);
+  }
+  sumChildren(tree.nodes, index, firstChild, childCount);
+}
+
+// Function to copy a part of the tree to the room joinTop made for it
+void copySubtree(Octree &tree, const TreeBuild &subtree) {
+  for (size_t i = 1; i < subtree.nodes.size(); i++) {
+    TreeNode &node = tree.nodes[subtree.offset + i];
+    node = subtree.nodes[i];
+    if (node.firstChild >= 0) {
+      node.firstChild += subtree.offset;
+    }
+  }
+  for (size_t i = 0; i < subtree.leaves.size(); i++) {
+    int leaf = subtree.leaves[i];
+    tree.leaves[subtree.leafOffset + i] =
+        leaf == 0 ? subtree.root : leaf + subtree.offset;
+  }
+}
+
+// Function to build the octree of the current body positions. Systems that
+// are flat in y only ever fill half of the octants, so they get the same
+// tree as a quadtree would give them. The bounds, the keys, the sort and the
+// parts of the tree below treeSplitLevel are shared among the workers of the
+// pool, and the tree is the same for any number of them
+void buildTree(Octree &tree, const BodySystem &system, ThreadPool &pool) {
+  size_t count = system.count;
+  tree.nodes.clear();
+  tree.leaves.clear();
+  if (count == 0) {
+    return;
+  }
+
+  size_t blocks = treeBlocks(count);
+  tree.bounds.resize(6 * blocks);
+  parallelFor(pool, 0, blocks, 1,
+              [&](size_t firstBlock, size_t lastBlock, unsigned int) {
+                for (size_t block = firstBlock; block < lastBlock; block++) {
+                  size_t begin = block * treeBlockSize;
+                  size_t end = std::min(count, begin + treeBlockSize);
+                  double *bounds = tree.bounds.data() + 6 * block;
+                  bounds[0] = bounds[1] = system.x[begin];
+                  bounds[2] = bounds[3] = system.y[begin];
+                  bounds[4] = bounds[5] = system.z[begin];
+                  for (size_t i = begin + 1; i < end; i++) {
+                    bounds[0] = std::min(bounds[0], system.x[i]);
+                    bounds[1] = std::max(bounds[1], system.x[i]);
+                    bounds[2] = std::min(bounds[2], system.y[i]);
+                    bounds[3] = std::max(bounds[3], system.y[i]);
+                    bounds[4] = std::min(bounds[4], system.z[i]);
+                    bounds[5] = std::max(bounds[5], system.z[i]);
+                  }
+                }
+              });
+  double minX = tree.bounds[0], maxX = tree.bounds[1];
+  double minY = tree.bounds[2], maxY = tree.bounds[3];
+  double minZ = tree.bounds[4], maxZ = tree.bounds[5];
+  for (size_t block = 1; block < blocks; block++) {
+    const double *bounds = tree.bounds.data() + 6 * block;
+    minX = std::min(minX, bounds[0]);
+    maxX = std::max(maxX, bounds[1]);
+    minY = std::min(minY, bounds[2]);
+    maxY = std::max(maxY, bounds[3]);
+    minZ = std::min(minZ, bounds[4]);
+    maxZ = std::max(maxZ, bounds[5]);
+  }
+  // Slightly enlarge the root so the bodies on its border get valid keys
+  double size =
+      std::max({maxX - minX, maxY - minY, maxZ - minZ}) * 1.0001 + 1;
+  double cellsPerUnit = (1 << treeLevels) / size;
+
+  tree.keys.resize(count);
+  tree.order.resize(count);
+  parallelFor(pool, 0, count, chunkSizeFor(pool, count, treeBlockSize),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  uint64_t ix = (system.x[i] - minX) * cellsPerUnit;
+                  uint64_t iy = (system.y[i] - minY) * cellsPerUnit;
+                  uint64_t iz = (system.z[i] - minZ) * cellsPerUnit;
+                  tree.keys[i] = spreadBits(ix) | (spreadBits(iy) << 1) |
+                                 (spreadBits(iz) << 2);
+                  tree.order[i] = i;
+                }
+              });
+  sortByKey(tree, count, pool);
+
+  tree.x.resize(count);
+  tree.y.resize(count);
+  tree.z.resize(count);
+  tree.mass.resize(count);
+  parallelFor(pool, 0, count, chunkSizeFor(pool, count, treeBlockSize),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  tree.x[i] = system.x[tree.order[i]];
+                  tree.y[i] = system.y[tree.order[i]];
+                  tree.z[i] = system.z[tree.order[i]];
+                  tree.mass[i] = system.mass[tree.order[i]];
+                }
+              });
+
+  TreeNode root;
+  root.minX = minX;
+  root.minY = minY;
+  root.minZ = minZ;
+  root.size = size;
+  root.begin = 0;
+  root.end = count;
+  tree.nodes.push_back(root);
+  tree.subtreeCount = 0;
+  splitTop(tree, 0, 0);
+
+  parallelFor(pool, 0, tree.subtreeCount, 1,
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t s = begin; s < end; s++) {
+                  TreeBuild &subtree = tree.subtrees[s];
+                  buildNode(tree, subtree, 0, subtree.level);
+                }
+              });
+
+  tree.nodes.resize(1);
+  size_t next = 0;
+  joinTop(tree, 0, 0, next);
+  parallelFor(pool, 0, tree.subtreeCount, 1,
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t s = begin; s < end; s++) {
+                  copySubtree(tree, tree.subtrees[s]);
+                }
+              });
+}
+
+// Function to make room for more masses at the end of an interaction list.
+// The arrays are filled by index rather than appended to, so the list keeps
+// its storage between leaves and only checks its size once per node
+void reserveInteractions(InteractionList &list, size_t more) {
+  size_t needed = list.count + more;
+  if (needed > list.mass.size()) {
+    size_t size = std::max(needed, 2 * list.mass.size());
+    for (BodyArray *array : {&list.x, &list.y, &list.z, &list.mass}) {
+      array->resize(size);
+    }
+  }
+}
+
+// Function to gather the masses acting on the bodies of a leaf. A cell is
+// taken as a whole when its size seen from the closest point of the leaf is
+// below the opening angle theta. The list ends with massless points up to a
+// multiple of pullWidth, so sumPull reads it in whole vectors
+void gatherInteractions(const Octree &tree, const TreeNode &leaf,
+                        double theta, InteractionList &list) {
+  list.count = 0;
+  list.stack.clear();
+  list.stack.push_back(0);
+
+  while (!list.stack.empty()) {
+    const TreeNode &node = tree.nodes[list.stack.back()];
+    list.stack.pop_back();
+
+    if (node.firstChild < 0) {
+      reserveInteractions(list, node.end - node.begin);
+      std::copy(tree.x.data() + node.begin, tree.x.data() + node.end,
+                list.x.data() + list.count);
+      std::copy(tree.y.data() + node.begin, tree.y.data() + node.end,
+                list.y.data() + list.count);
+      std::copy(tree.z.data() + node.begin, tree.z.data() + node.end,
+                list.z.data() + list.count);
+      std::copy(tree.mass.data() + node.begin, tree.mass.data() + node.end,
+                list.mass.data() + list.count);
+      list.count += node.end - node.begin;
+      continue;
+    }
+
+    double dx = std::max(
+        {leaf.minX - node.comX, 0.0, node.comX - leaf.minX - leaf.size});
+    double dy = std::max(
+        {leaf.minY - node.comY, 0.0, node.comY - leaf.minY - leaf.size});
+    double dz = std::max(
+        {leaf.minZ - node.comZ, 0.0, node.comZ - leaf.minZ - leaf.size});
+    double distance2 = dx * dx + dy * dy + dz * dz;
+
+    if (node.size * node.size < theta * theta * distance2) {
+      reserveInteractions(list, 1);
+      list.x[list.count] = node.comX;
+      list.y[list.count] = node.comY;
+      list.z[list.count] = node.comZ;
+      list.mass[list.count] = node.mass;
+      list.count++;
+    } else {
+      for (int child = node.firstChild;
+           child < node.firstChild + node.childCount; child++) {
+        list.stack.push_back(child);
+      }
+    }
+  }
+
+  reserveInteractions(list, pullWidth);
+  while (list.count % pullWidth != 0) {
+    list.x[list.count] = list.y[list.count] = list.z[list.count] = 0;
+    list.mass[list.count] = 0;
+    list.count++;
+  }
+}
+
+// Function to compute the accelerations of the bodies in the leaves
+// [firstLeaf, lastLeaf) of a built tree, softened by the given length
+void computeLeafAccelerations(const Octree &tree, BodySystem &system,
+                              double theta, double softening,
+                              size_t firstLeaf, size_t lastLeaf,
+                              InteractionList &list) {
+  for (size_t l = firstLeaf; l < lastLeaf; l++) {
+    const TreeNode &leaf = tree.nodes[tree.leaves[l]];
+    gatherInteractions(tree, leaf, theta, list);
+
+    for (unsigned int i = leaf.begin; i < leaf.end; i++) {
+      double sumX, sumY, sumZ;
+      sumPull(list.x.data(), list.y.data(), list.z.data(), list.mass.data(),
+              list.count, tree.x[i], tree.y[i], tree.z[i],
+              softening * softening, sumX, sumY, sumZ);
+      system.ax[tree.order[i]] = gravitationalConstant * sumX;
+      system.ay[tree.order[i]] = gravitationalConstant * sumY;
+      system.az[tree.order[i]] = gravitationalConstant * sumZ;
+    }
+  }
+}
+
+// Function to compute the acceleration of every body with the Barnes-Hut
+// approximation. The leaves are shared among the workers of the pool, and
+// every body gets the same interaction list whichever worker handles it
+void computeAccelerationsBarnesHut(Octree &tree, BodySystem &system,
+                                   double theta, double softening,
+                                   ThreadPool &pool) {
+  buildTree(tree, system, pool);
+  tree.lists.resize(workerCount(pool));
+
+  parallelFor(pool, 0, tree.leaves.size(),
+              chunkSizeFor(pool, tree.leaves.size(), 4),
+              [&](size_t begin, size_t end, unsigned int worker) {
+                computeLeafAccelerations(tree, system, theta, softening,
+                                         begin, end, tree.lists[worker]);
+              });
+}
+
+#endif
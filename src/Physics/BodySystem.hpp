@@ -0,0 +1,125 @@
+#ifndef BODY_SYSTEM_HPP
+#define BODY_SYSTEM_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Alignment (in bytes) of every array of the body system, wide enough for the
+// largest vector registers used by the gravity kernels
+const size_t simdAlignment = 64;
+
+// Allocator that keeps the body arrays aligned to simdAlignment
+template <typename T> struct AlignedAllocator {
+  typedef T value_type;
+
+  AlignedAllocator() = default;
+  template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    size_t bytes = (n * sizeof(T) + simdAlignment - 1) / simdAlignment *
+                   simdAlignment;
+    void *memory = aligned_alloc(simdAlignment, bytes);
+    if (memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(memory);
+  }
+
+  void deallocate(T *memory, size_t) { free(memory); }
+
+  template <typename U> bool operator==(const AlignedAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const AlignedAllocator<U> &) const {
+    return false;
+  }
+};
+
+typedef std::vector<double, AlignedAllocator<double>> BodyArray;
+
+// Define a structure holding the physical state of every simulated body as a
+// structure of arrays, so the gravity kernels can stream through contiguous
+// memory. Bodies are addressed by index, and optionally by name. The index
+// of a body changes when a body before it is removed, but not its id
+struct BodySystem {
+  size_t count = 0;
+  BodyArray mass;
+  BodyArray x, y, z;
+  BodyArray vx, vy, vz;
+  BodyArray ax, ay, az;
+  std::vector<std::string> names;
+  std::vector<uint32_t> ids; // in the order the bodies were added
+  uint32_t nextId = 0;
+  std::unordered_map<std::string, size_t> indexByName;
+};
+
+// Function to reserve room for a given number of bodies
+void reserveBodies(BodySystem &system, size_t capacity) {
+  for (BodyArray *array :
+       {&system.mass, &system.x, &system.y, &system.z, &system.vx, &system.vy,
+        &system.vz, &system.ax, &system.ay, &system.az}) {
+    array->reserve(capacity);
+  }
+  system.names.reserve(capacity);
+  system.ids.reserve(capacity);
+}
+
+// Function to add a body to the system, returning its index. Bodies with an
+// empty name can only be addressed by index
+size_t addBody(BodySystem &system, const std::string &name, double mass,
+               double x, double y, double z, double vx, double vy,
+               double vz) {
+  size_t index = system.count++;
+  system.mass.push_back(mass);
+  system.x.push_back(x);
+  system.y.push_back(y);
+  system.z.push_back(z);
+  system.vx.push_back(vx);
+  system.vy.push_back(vy);
+  system.vz.push_back(vz);
+  system.ax.push_back(0);
+  system.ay.push_back(0);
+  system.az.push_back(0);
+  system.names.push_back(name);
+  system.ids.push_back(system.nextId++);
+
+  if (!name.empty()) {
+    system.indexByName[name] = index;
+  }
+
+  return index;
+}
+
+// Function to find a body by its name, returning -1 if it does not exist
+int findBody(const BodySystem &system, const std::string &name) {
+  auto it = system.indexByName.find(name);
+  return it == system.indexByName.end() ? -1 : (int)it->second;
+}
+
+// Function to remove the net momentum of the system, so its center of mass
+// stays still instead of drifting away from the origin
+void removeNetMomentum(BodySystem &system) {
+  double totalMass = 0, px = 0, py = 0, pz = 0;
+  for (size_t i = 0; i < system.count; i++) {
+    totalMass += system.mass[i];
+    px += system.mass[i] * system.vx[i];
+    py += system.mass[i] * system.vy[i];
+    pz += system.mass[i] * system.vz[i];
+  }
+
+  if (totalMass == 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < system.count; i++) {
+    system.vx[i] -= px / totalMass;
+    system.vy[i] -= py / totalMass;
+    system.vz[i] -= pz / totalMass;
+  }
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef COLLISIONS_HPP
+#define COLLISIONS_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "BodySystem.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Density giving the radius of every body from its mass, in kg/m^3, that of
+// rocky asteroids. Merged bodies keep it, so their volumes add up
+const double collisionDensity = 2000;
+// Largest number of bodies too big for the cells of the spatial hash, which
+// are tested against every other body instead. Only the bodies whose box is
+// also several times the median one are left out of the grid
+const size_t collisionLargeBodies = 32;
+const double collisionLargeRatio = 4;
+
+typedef std::pair<size_t, size_t> CollisionPair;
+
+// Define a structure for detecting and merging the bodies that touch during a
+// step. Every body is bounded by the box it swept over the step, and the
+// boxes are hashed into a uniform grid of cells as large as the largest of
+// them, so only the bodies of neighbouring cells are compared and each step
+// costs a time linear in the number of bodies. The buffers are kept between
+// steps, so their memory is only allocated as the system grows
+struct Collisions {
+  bool enabled = false;
+  long merges = 0; // bodies absorbed since the start
+  double cellSize = 0;
+  double gridReach = 0; // largest half size of the boxes in the grid
+  BodyArray radius;
+  // Center and half size of the box swept by each body over the step
+  BodyArray centerX, centerY, centerZ, reach, sortedReach;
+  std::vector<int64_t> cellX, cellY, cellZ;
+  std::vector<char> large;
+  std::vector<size_t> largeBodies;
+  // Bodies of the grid sorted by the bucket of their cell, with the key of
+  // their cell beside them, so the bodies of other cells sharing a bucket are
+  // skipped without reading them
+  std::vector<unsigned int> bucket, bucketStart, order;
+  std::vector<uint64_t> cellKey, orderKey;
+  std::vector<std::vector<CollisionPair>> found; // per worker
+  std::vector<CollisionPair> pairs;
+  std::vector<size_t> absorber; // body each body was merged into
+  std::vector<size_t> removed;
+};
+
+// Function to pack the coordinates of a cell into a key, 21 bits each. Cells
+// two million apart share their key, which only costs a narrow test more
+uint64_t collisionKey(int64_t x, int64_t y, int64_t z) {
+  const uint64_t mask = (1ull << 21) - 1;
+  return ((uint64_t)x & mask) << 42 | ((uint64_t)y & mask) << 21 |
+         ((uint64_t)z & mask);
+}
+
+// Function to hash the key of a cell into one of the buckets, whose number is
+// a power of two
+unsigned int collisionBucket(uint64_t key, size_t buckets) {
+  uint64_t h = key * 0x9E3779B97F4A7C15ull;
+  return (h ^ h >> 32) & (buckets - 1);
+}
+
+// Function to tell whether two bodies touched during the last step of
+// duration dt, assuming they moved in straight lines at their current
+// velocities. The closest approach of the two is found over the whole step,
+// so fast bodies cannot jump through each other
+bool sweptContact(const Collisions &collisions, const BodySystem &system,
+                  size_t i, size_t j, double dt) {
+  double dx = system.x[j] - system.x[i];
+  double dy = system.y[j] - system.y[i];
+  double dz = system.z[j] - system.z[i];
+  double wx = (system.vx[j] - system.vx[i]) * dt;
+  double wy = (system.vy[j] - system.vy[i]) * dt;
+  double wz = (system.vz[j] - system.vz[i]) * dt;
+  double w2 = wx * wx + wy * wy + wz * wz;
+  // Fraction of the step before its end at which they were the closest
+  double back = w2 > 0 ? (dx * wx + dy * wy + dz * wz) / w2 : 0;
+  back = std::max(0.0, std::min(1.0, back));
+  dx -= back * wx;
+  dy -= back * wy;
+  dz -= back * wz;
+  double contact = collisions.radius[i] + collisions.radius[j];
+  return dx * dx + dy * dy + dz * dz < contact * contact;
+}
+
+// Function to bound every body by the box it swept over the last step, and
+// to find the bodies too large for the cells of the grid
+void boundCollisionBodies(Collisions &collisions, const BodySystem &system,
+                          double dt, ThreadPool &pool) {
+  size_t count = system.count;
+  double volumePerMass = 3 / (4 * M_PI * collisionDensity);
+  parallelFor(pool, 0, count, chunkSizeFor(pool, count, 4096),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  double r = std::cbrt(system.mass[i] * volumePerMass);
+                  double sx = std::fabs(system.vx[i] * dt) / 2;
+                  double sy = std::fabs(system.vy[i] * dt) / 2;
+                  double sz = std::fabs(system.vz[i] * dt) / 2;
+                  collisions.radius[i] = r;
+                  collisions.centerX[i] = system.x[i] - system.vx[i] * dt / 2;
+                  collisions.centerY[i] = system.y[i] - system.vy[i] * dt / 2;
+                  collisions.centerZ[i] = system.z[i] - system.vz[i] * dt / 2;
+                  collisions.reach[i] = r + std::max(sx, std::max(sy, sz));
+                }
+              });
+
+  // The bodies above the one ranked collisionLargeBodies by size, and above
+  // collisionLargeRatio times the median one, are left out of the grid
+  double threshold = -1;
+  if (count > collisionLargeBodies) {
+    BodyArray &sorted = collisions.sortedReach;
+    sorted.assign(collisions.reach.begin(), collisions.reach.end());
+    auto rank = sorted.end() - collisionLargeBodies;
+    std::nth_element(sorted.begin(), rank, sorted.end());
+    threshold = *rank;
+    auto median = sorted.begin() + count / 2;
+    std::nth_element(sorted.begin(), median, rank);
+    threshold = std::max(threshold, collisionLargeRatio * *median);
+  }
+
+  // The cells are as large as the largest box left in the grid
+  double largestReach = 0;
+  collisions.largeBodies.clear();
+  for (size_t i = 0; i < count; i++) {
+    collisions.large[i] = collisions.reach[i] > threshold;
+    if (collisions.large[i]) {
+      collisions.largeBodies.push_back(i);
+    } else {
+      largestReach = std::max(largestReach, collisions.reach[i]);
+    }
+  }
+  collisions.gridReach = largestReach;
+  collisions.cellSize = std::max(2 * largestReach, 1.0);
+}
+
+// Function to sort the bodies of the grid by the bucket of their cell, with a
+// counting sort. There are at least four buckets per body, so most of the
+// empty cells around a body fall in empty buckets
+void hashCollisionBodies(Collisions &collisions, size_t count) {
+  size_t buckets = 1;
+  while (buckets < 4 * count) {
+    buckets *= 2;
+  }
+  collisions.bucketStart.assign(buckets + 1, 0);
+  for (size_t i = 0; i < count; i++) {
+    if (collisions.large[i]) {
+      continue;
+    }
+    double size = collisions.cellSize;
+    collisions.cellX[i] = std::floor(collisions.centerX[i] / size);
+    collisions.cellY[i] = std::floor(collisions.centerY[i] / size);
+    collisions.cellZ[i] = std::floor(collisions.centerZ[i] / size);
+    collisions.cellKey[i] = collisionKey(
+        collisions.cellX[i], collisions.cellY[i], collisions.cellZ[i]);
+    collisions.bucket[i] = collisionBucket(collisions.cellKey[i], buckets);
+    collisions.bucketStart[collisions.bucket[i] + 1]++;
+  }
+  for (size_t b = 0; b < buckets; b++) {
+    collisions.bucketStart[b + 1] += collisions.bucketStart[b];
+  }
+  size_t gridded = collisions.bucketStart[buckets];
+  collisions.order.resize(gridded);
+  collisions.orderKey.resize(gridded);
+  // The starts are advanced while filling, then shifted back
+  for (size_t i = 0; i < count; i++) {
+    if (!collisions.large[i]) {
+      unsigned int k = collisions.bucketStart[collisions.bucket[i]]++;
+      collisions.order[k] = i;
+      collisions.orderKey[k] = collisions.cellKey[i];
+    }
+  }
+  for (size_t b = buckets; b > 0; b--) {
+    collisions.bucketStart[b] = collisions.bucketStart[b - 1];
+  }
+  collisions.bucketStart[0] = 0;
+}
+
+// Function to find the pairs of bodies [begin, end) that touched during the
+// last step: against every large body, and in the grid, against the bodies
+// after them in the cells their box reaches once grown by the largest box of
+// the grid, which are 8 at most with cells twice as large as that box
+void findCollisionPairs(const Collisions &collisions,
+                        const BodySystem &system, double dt, size_t begin,
+                        size_t end, std::vector<CollisionPair> &found) {
+  size_t buckets = collisions.bucketStart.size() - 1;
+  double size = collisions.cellSize;
+  for (size_t i = begin; i < end; i++) {
+    for (size_t body : collisions.largeBodies) {
+      // Pairs of large bodies are found once, from the later one
+      if (body != i && (!collisions.large[i] || body < i) &&
+          sweptContact(collisions, system, body, i, dt)) {
+        found.push_back({std::min(body, i), std::max(body, i)});
+      }
+    }
+    if (collisions.large[i]) {
+      continue;
+    }
+
+    double h = collisions.reach[i] + collisions.gridReach;
+    int64_t lowX = std::floor((collisions.centerX[i] - h) / size);
+    int64_t lowY = std::floor((collisions.centerY[i] - h) / size);
+    int64_t lowZ = std::floor((collisions.centerZ[i] - h) / size);
+    int64_t highX = std::floor((collisions.centerX[i] + h) / size);
+    int64_t highY = std::floor((collisions.centerY[i] + h) / size);
+    int64_t highZ = std::floor((collisions.centerZ[i] + h) / size);
+    for (int64_t cx = lowX; cx <= highX; cx++) {
+      for (int64_t cy = lowY; cy <= highY; cy++) {
+        for (int64_t cz = lowZ; cz <= highZ; cz++) {
+          uint64_t key = collisionKey(cx, cy, cz);
+          unsigned int b = collisionBucket(key, buckets);
+          for (unsigned int k = collisions.bucketStart[b];
+               k < collisions.bucketStart[b + 1]; k++) {
+            // Other cells may share the bucket
+            if (collisions.orderKey[k] != key) {
+              continue;
+            }
+            size_t j = collisions.order[k];
+            if (j > i && sweptContact(collisions, system, i, j, dt)) {
+              found.push_back({i, j});
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Function to find the body a body ended up merged into
+size_t collisionSurvivor(std::vector<size_t> &absorber, size_t body) {
+  while (absorber[body] != body) {
+    absorber[body] = absorber[absorber[body]];
+    body = absorber[body];
+  }
+  return body;
+}
+
+// Function to merge the body absorbed into the survivor, conserving their
+// mass and their momentum. The survivor moves to their center of mass
+void mergeBodies(BodySystem &system, size_t survivor, size_t absorbed) {
+  double m1 = system.mass[survivor], m2 = system.mass[absorbed];
+  double mass = m1 + m2;
+  if (mass > 0) {
+    for (BodyArray *array : {&system.x, &system.y, &system.z, &system.vx,
+                             &system.vy, &system.vz}) {
+      (*array)[survivor] =
+          (m1 * (*array)[survivor] + m2 * (*array)[absorbed]) / mass;
+    }
+  }
+  system.mass[survivor] = mass;
+}
+
+// Function to remove a body from the system by moving the last one in its
+// place, so no array is ever reallocated. The moved body keeps its id
+void removeBody(BodySystem &system, size_t body) {
+  size_t last = system.count - 1;
+  for (BodyArray *array :
+       {&system.mass, &system.x, &system.y, &system.z, &system.vx, &system.vy,
+        &system.vz, &system.ax, &system.ay, &system.az}) {
+    (*array)[body] = (*array)[last];
+    array->pop_back();
+  }
+  if (body != last) {
+    if (!system.names[last].empty()) {
+      system.indexByName[system.names[last]] = body;
+    }
+    system.names[body] = std::move(system.names[last]);
+    system.ids[body] = system.ids[last];
+  }
+  system.names.pop_back();
+  system.ids.pop_back();
+  system.count--;
+}
+
+// Function to merge the bodies that touched during the last step of duration
+// dt (negative backwards in time), returning how many were absorbed. The
+// named bodies are never absorbed, so their indices do not change: they
+// absorb the unnamed bodies they touch, and pass through each other. The
+// pairs are merged in the order of their indices, so the result does not
+// depend on the number of threads
+size_t resolveCollisions(Collisions &collisions, BodySystem &system,
+                         double dt, ThreadPool &pool) {
+  size_t count = system.count;
+  for (BodyArray *array :
+       {&collisions.radius, &collisions.centerX, &collisions.centerY,
+        &collisions.centerZ, &collisions.reach}) {
+    array->resize(count);
+  }
+  collisions.cellX.resize(count);
+  collisions.cellY.resize(count);
+  collisions.cellZ.resize(count);
+  collisions.cellKey.resize(count);
+  collisions.large.resize(count);
+  collisions.bucket.resize(count);
+
+  boundCollisionBodies(collisions, system, dt, pool);
+  hashCollisionBodies(collisions, count);
+  collisions.found.resize(workerCount(pool));
+  for (std::vector<CollisionPair> &found : collisions.found) {
+    found.clear();
+  }
+  parallelFor(pool, 0, count, chunkSizeFor(pool, count, 1024),
+              [&](size_t begin, size_t end, unsigned int worker) {
+                findCollisionPairs(collisions, system, dt, begin, end,
+                                   collisions.found[worker]);
+              });
+
+  collisions.pairs.clear();
+  for (const std::vector<CollisionPair> &found : collisions.found) {
+    collisions.pairs.insert(collisions.pairs.end(), found.begin(),
+                            found.end());
+  }
+  if (collisions.pairs.empty()) {
+    return 0;
+  }
+  std::sort(collisions.pairs.begin(), collisions.pairs.end());
+
+  collisions.absorber.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    collisions.absorber[i] = i;
+  }
+  collisions.removed.clear();
+  for (const CollisionPair &pair : collisions.pairs) {
+    size_t a = collisionSurvivor(collisions.absorber, pair.first);
+    size_t b = collisionSurvivor(collisions.absorber, pair.second);
+    bool namedA = !system.names[a].empty(), namedB = !system.names[b].empty();
+    if (a == b || (namedA && namedB)) {
+      continue;
+    }
+    size_t survivor = namedA ? a : namedB ? b : std::min(a, b);
+    size_t absorbed = survivor == a ? b : a;
+    mergeBodies(system, survivor, absorbed);
+    collisions.absorber[absorbed] = survivor;
+    collisions.removed.push_back(absorbed);
+  }
+
+  // Removed from the last, so the bodies moved in their place stay
+  std::sort(collisions.removed.rbegin(), collisions.removed.rend());
+  for (size_t body : collisions.removed) {
+    removeBody(system, body);
+  }
+  collisions.merges += collisions.removed.size();
+  return collisions.removed.size();
+}
+
+#endif
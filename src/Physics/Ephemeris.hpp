@@ -0,0 +1,198 @@
+#ifndef EPHEMERIS_HPP
+#define EPHEMERIS_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "BodySystem.hpp"
+#include "Gravity.hpp"
+#include "Kepler.hpp"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Define the bodies that follow their orbit around their parent in closed
+// form instead of being integrated, so they can be placed at any time with
+// the same work. Bodies without a parent move in a straight line. The orbits
+// are kept as structures of arrays, solved together in vector lanes
+struct Ephemeris {
+  size_t count = 0; // bodies on an orbit
+  double epoch = 0; // simulated time of the initial mean anomalies
+  std::vector<size_t> bodies; // index in the body system, parents first
+  std::vector<int> parents;   // index of the parent in the body system
+  BodyArray semiMajorAxis, eccentricity, meanMotion, initialAnomaly;
+  // Directions of the periapsis and of the point 90 degrees ahead of it
+  BodyArray px, py, pz, qx, qy, qz;
+  // Scratch of the solver, then positions and velocities from the parents
+  BodyArray meanAnomaly, anomaly, sine, cosine;
+  BodyArray x, y, z, vx, vy, vz;
+  std::vector<size_t> lineBodies; // bodies without a parent
+  std::vector<double> lineStates; // x, y, z, vx, vy, vz of each at the epoch
+};
+
+// Function to remove every body from the ephemeris, starting it again at the
+// given time
+void clearEphemeris(Ephemeris &ephemeris, double epoch) {
+  ephemeris = Ephemeris();
+  ephemeris.epoch = epoch;
+}
+
+// Function to add a body to the ephemeris, on the orbit around its parent
+// given by their current states, or on a straight line if it has no parent
+// (a negative index). Parents must be added before their children. Returns
+// false if the body is not on a closed orbit
+bool addEphemerisBody(Ephemeris &ephemeris, const BodySystem &system,
+                      size_t body, int parent) {
+  if (parent < 0) {
+    ephemeris.lineBodies.push_back(body);
+    for (double value : {system.x[body], system.y[body], system.z[body],
+                         system.vx[body], system.vy[body], system.vz[body]}) {
+      ephemeris.lineStates.push_back(value);
+    }
+    return true;
+  }
+
+  double rx = system.x[body] - system.x[parent];
+  double ry = system.y[body] - system.y[parent];
+  double rz = system.z[body] - system.z[parent];
+  double vx = system.vx[body] - system.vx[parent];
+  double vy = system.vy[body] - system.vy[parent];
+  double vz = system.vz[body] - system.vz[parent];
+  double mu = gravitationalConstant * (system.mass[body] + system.mass[parent]);
+
+  // The semi-major axis follows from the energy, and the eccentricity vector
+  // points to the periapsis
+  double r = std::sqrt(rx * rx + ry * ry + rz * rz);
+  double v2 = vx * vx + vy * vy + vz * vz;
+  double a = 1 / (2 / r - v2 / mu);
+  double hx = ry * vz - rz * vy, hy = rz * vx - rx * vz, hz = rx * vy - ry * vx;
+  double h = std::sqrt(hx * hx + hy * hy + hz * hz);
+  double ex = (vy * hz - vz * hy) / mu - rx / r;
+  double ey = (vz * hx - vx * hz) / mu - ry / r;
+  double ez = (vx * hy - vy * hx) / mu - rz / r;
+  double e = std::sqrt(ex * ex + ey * ey + ez * ez);
+  if (!(r > 0 && a > 0 && h > 0 && e < 1)) {
+    std::cerr << "'" << system.names[body]
+              << "' is not on a closed orbit around '"
+              << system.names[parent] << "'." << std::endl;
+    return false;
+  }
+
+  // A circular orbit has no periapsis, so its angles start from the body
+  double p[3] = {rx / r, ry / r, rz / r};
+  if (e > 1e-12) {
+    p[0] = ex / e, p[1] = ey / e, p[2] = ez / e;
+  } else {
+    e = 0;
+  }
+  double q[3] = {(hy * p[2] - hz * p[1]) / h, (hz * p[0] - hx * p[2]) / h,
+                 (hx * p[1] - hy * p[0]) / h};
+  double minorRatio = std::sqrt(1 - e * e);
+  double cosE = (rx * p[0] + ry * p[1] + rz * p[2]) / a + e;
+  double sinE = (rx * q[0] + ry * q[1] + rz * q[2]) / (a * minorRatio);
+  double anomaly = std::atan2(sinE, cosE);
+
+  ephemeris.count++;
+  ephemeris.bodies.push_back(body);
+  ephemeris.parents.push_back(parent);
+  ephemeris.semiMajorAxis.push_back(a);
+  ephemeris.eccentricity.push_back(e);
+  ephemeris.meanMotion.push_back(std::sqrt(mu / (a * a * a)));
+  ephemeris.initialAnomaly.push_back(anomaly - e * std::sin(anomaly));
+  ephemeris.px.push_back(p[0]);
+  ephemeris.py.push_back(p[1]);
+  ephemeris.pz.push_back(p[2]);
+  ephemeris.qx.push_back(q[0]);
+  ephemeris.qy.push_back(q[1]);
+  ephemeris.qz.push_back(q[2]);
+  for (BodyArray *array :
+       {&ephemeris.meanAnomaly, &ephemeris.anomaly, &ephemeris.sine,
+        &ephemeris.cosine, &ephemeris.x, &ephemeris.y, &ephemeris.z,
+        &ephemeris.vx, &ephemeris.vy, &ephemeris.vz}) {
+    array->push_back(0);
+  }
+  return true;
+}
+
+// Function to tell whether every body of a system follows the ephemeris, so
+// it can jump to any time without integrating anything
+bool ephemerisCoversSystem(const Ephemeris &ephemeris,
+                           const BodySystem &system) {
+  return ephemeris.count + ephemeris.lineBodies.size() == system.count;
+}
+
+// Function to compute the orbits [begin, end) of the ephemeris at a given
+// time, relative to the parents
+void solveEphemerisOrbits(Ephemeris &ephemeris, double time, size_t begin,
+                          size_t end) {
+  double elapsed = time - ephemeris.epoch;
+  for (size_t i = begin; i < end; i++) {
+    double m = ephemeris.initialAnomaly[i] + ephemeris.meanMotion[i] * elapsed;
+    ephemeris.meanAnomaly[i] = m - 2 * M_PI * std::nearbyint(m * 0.5 * M_1_PI);
+  }
+  solveKeplerLanes(&ephemeris.meanAnomaly[begin],
+                   &ephemeris.eccentricity[begin], end - begin,
+                   &ephemeris.anomaly[begin], &ephemeris.sine[begin],
+                   &ephemeris.cosine[begin]);
+
+  for (size_t i = begin; i < end; i++) {
+    double a = ephemeris.semiMajorAxis[i], e = ephemeris.eccentricity[i];
+    double sinE = ephemeris.sine[i], cosE = ephemeris.cosine[i];
+    double minorRatio = std::sqrt(1 - e * e);
+    double rate = ephemeris.meanMotion[i] / (1 - e * cosE);
+    double p = a * (cosE - e), q = a * minorRatio * sinE;
+    double vp = -a * sinE * rate, vq = a * minorRatio * cosE * rate;
+    ephemeris.x[i] = p * ephemeris.px[i] + q * ephemeris.qx[i];
+    ephemeris.y[i] = p * ephemeris.py[i] + q * ephemeris.qy[i];
+    ephemeris.z[i] = p * ephemeris.pz[i] + q * ephemeris.qz[i];
+    ephemeris.vx[i] = vp * ephemeris.px[i] + vq * ephemeris.qx[i];
+    ephemeris.vy[i] = vp * ephemeris.py[i] + vq * ephemeris.qy[i];
+    ephemeris.vz[i] = vp * ephemeris.pz[i] + vq * ephemeris.qz[i];
+  }
+}
+
+// Function to place every body of the ephemeris at a given time. The orbits
+// are solved in parallel, then added to their parents in order, so a body
+// follows its parent whether the parent is integrated or not
+void placeEphemerisBodies(Ephemeris &ephemeris, BodySystem &system,
+                          double time, ThreadPool &pool) {
+  double elapsed = time - ephemeris.epoch;
+  for (size_t i = 0; i < ephemeris.lineBodies.size(); i++) {
+    size_t body = ephemeris.lineBodies[i];
+    const double *state = &ephemeris.lineStates[6 * i];
+    system.x[body] = state[0] + state[3] * elapsed;
+    system.y[body] = state[1] + state[4] * elapsed;
+    system.z[body] = state[2] + state[5] * elapsed;
+    system.vx[body] = state[3];
+    system.vy[body] = state[4];
+    system.vz[body] = state[5];
+  }
+
+  parallelFor(pool, 0, ephemeris.count,
+              chunkSizeFor(pool, ephemeris.count, 4096),
+              [&](size_t begin, size_t end, unsigned int) {
+                solveEphemerisOrbits(ephemeris, time, begin, end);
+              });
+
+  for (size_t i = 0; i < ephemeris.count; i++) {
+    size_t body = ephemeris.bodies[i];
+    size_t parent = ephemeris.parents[i];
+    system.x[body] = system.x[parent] + ephemeris.x[i];
+    system.y[body] = system.y[parent] + ephemeris.y[i];
+    system.z[body] = system.z[parent] + ephemeris.z[i];
+    system.vx[body] = system.vx[parent] + ephemeris.vx[i];
+    system.vy[body] = system.vy[parent] + ephemeris.vy[i];
+    system.vz[body] = system.vz[parent] + ephemeris.vz[i];
+  }
+}
+
+// Function to clear the accelerations of the bodies of the ephemeris, so the
+// kicks of the integrator leave their velocities as the orbits give them
+void holdEphemerisBodies(const Ephemeris &ephemeris, BodySystem &system) {
+  for (const std::vector<size_t> *bodies :
+       {&ephemeris.bodies, &ephemeris.lineBodies}) {
+    for (size_t body : *bodies) {
+      system.ax[body] = system.ay[body] = system.az[body] = 0;
+    }
+  }
+}
+
+#endif
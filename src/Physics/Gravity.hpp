@@ -0,0 +1,322 @@
+#ifndef GRAVITY_HPP
+#define GRAVITY_HPP
+
+#include "BodySystem.hpp"
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+const double gravitationalConstant = 6.67430e-11;
+// Independent systems advanced together by the lane kernels, one per lane
+const size_t ensembleLanes = 8;
+// Masses summed together by sumPull, one per lane of the vector registers
+#if defined(__AVX512F__)
+const size_t pullWidth = 8;
+#elif defined(__AVX__)
+const size_t pullWidth = 4;
+#else
+const size_t pullWidth = 1;
+#endif
+
+// Function to add the pull of the point masses [begin, end) on the point
+// (xi, yi, zi). Masses lying exactly on the point (the body itself, in
+// particular) are skipped, and softening2, the square of the softening
+// length, is added to every squared distance so close pairs stay finite. The
+// sums are returned without the gravitational constant
+void sumPullScalar(const double *x, const double *y, const double *z,
+                   const double *mass, size_t begin, size_t end, double xi,
+                   double yi, double zi, double softening2, double &sumX,
+                   double &sumY, double &sumZ) {
+  for (size_t j = begin; j < end; j++) {
+    double dx = x[j] - xi;
+    double dy = y[j] - yi;
+    double dz = z[j] - zi;
+    double r2 = dx * dx + dy * dy + dz * dz;
+    if (r2 > 0) {
+      double inverseR = 1 / std::sqrt(r2 + softening2);
+      double s = mass[j] * inverseR * inverseR * inverseR;
+      sumX += s * dx;
+      sumY += s * dy;
+      sumZ += s * dz;
+    }
+  }
+}
+
+#if defined(__AVX512F__)
+// Function to compute 1 / sqrt(r2) of the valid lanes, and 0 in the others.
+// The 14-bit estimate of the hardware is refined by two Newton steps, each
+// doubling its correct bits, which gets within an ulp or two of the exact
+// value at the cost of a few multiplications instead of a square root and a
+// division, which both wait for the slow divider
+__m512d inverseSqrt(__m512d r2, __mmask8 valid) {
+  __m512d estimate = _mm512_maskz_rsqrt14_pd(valid, r2);
+  __m512d halfR2 = _mm512_mul_pd(r2, _mm512_set1_pd(0.5));
+  __m512d threeHalves = _mm512_set1_pd(1.5);
+  for (int step = 0; step < 2; step++) {
+    __m512d correction = _mm512_fnmadd_pd(
+        _mm512_mul_pd(halfR2, estimate), estimate, threeHalves);
+    estimate = _mm512_mul_pd(estimate, correction);
+  }
+  return estimate;
+}
+
+// Function to add the pull of count point masses on the point (xi, yi, zi),
+// 8 masses at a time. The last masses are loaded under a mask, so the lanes
+// past the end read as massless points and the tail costs a single pass
+void sumPull(const double *x, const double *y, const double *z,
+             const double *mass, size_t count, double xi, double yi,
+             double zi, double softening2, double &sumX, double &sumY,
+             double &sumZ) {
+  const size_t width = 8;
+  __m512d pointX = _mm512_set1_pd(xi);
+  __m512d pointY = _mm512_set1_pd(yi);
+  __m512d pointZ = _mm512_set1_pd(zi);
+  __m512d softening = _mm512_set1_pd(softening2);
+  __m512d zero = _mm512_setzero_pd();
+  __m512d accX = zero, accY = zero, accZ = zero;
+
+  for (size_t j = 0; j < count; j += width) {
+    __mmask8 lanes =
+        j + width <= count ? 0xff : __mmask8((1u << (count - j)) - 1);
+    __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, x + j), pointX);
+    __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, y + j), pointY);
+    __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, z + j), pointZ);
+    __m512d r2 = _mm512_fmadd_pd(
+        dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+    __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+    __m512d inverseR = inverseSqrt(_mm512_add_pd(r2, softening), valid);
+    __m512d inverseR3 =
+        _mm512_mul_pd(_mm512_mul_pd(inverseR, inverseR), inverseR);
+    __m512d s =
+        _mm512_mul_pd(_mm512_maskz_loadu_pd(lanes, mass + j), inverseR3);
+    accX = _mm512_fmadd_pd(s, dx, accX);
+    accY = _mm512_fmadd_pd(s, dy, accY);
+    accZ = _mm512_fmadd_pd(s, dz, accZ);
+  }
+
+  sumX = _mm512_reduce_add_pd(accX);
+  sumY = _mm512_reduce_add_pd(accY);
+  sumZ = _mm512_reduce_add_pd(accZ);
+}
+#elif defined(__AVX__)
+// Function to horizontally add the four lanes of a vector
+double horizontalSum(__m256d v) {
+  __m128d sum =
+      _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+  return _mm_cvtsd_f64(sum);
+}
+
+// Function to compute a * b + c, fused when the processor can
+__m256d multiplyAdd(__m256d a, __m256d b, __m256d c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_pd(a, b, c);
+#else
+  return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+
+// Function to add the pull of 4 masses, at (dx, dy, dz) from the point, to
+// the sums of their lanes. The mass is divided by r^3 at once, so each pair
+// takes a single division and a single square root
+void addPull(__m256d dx, __m256d dy, __m256d dz, __m256d mass,
+             __m256d softening, __m256d &accX, __m256d &accY,
+             __m256d &accZ) {
+  __m256d r2 = multiplyAdd(dz, dz, multiplyAdd(dy, dy, _mm256_mul_pd(dx, dx)));
+  __m256d valid = _mm256_cmp_pd(r2, _mm256_setzero_pd(), _CMP_GT_OQ);
+  r2 = _mm256_add_pd(r2, softening);
+  __m256d s = _mm256_and_pd(
+      valid, _mm256_div_pd(mass, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2))));
+  accX = multiplyAdd(s, dx, accX);
+  accY = multiplyAdd(s, dy, accY);
+  accZ = multiplyAdd(s, dz, accZ);
+}
+
+// Function to add the pull of count point masses on the point (xi, yi, zi),
+// 4 masses at a time. Lists padded to a multiple of pullWidth are read in
+// whole vectors, and the remaining masses of others are loaded under a mask
+// in a last pass, where the lanes past the end read as massless points
+void sumPull(const double *x, const double *y, const double *z,
+             const double *mass, size_t count, double xi, double yi,
+             double zi, double softening2, double &sumX, double &sumY,
+             double &sumZ) {
+  const size_t width = 4;
+  size_t vectorEnd = count / width * width;
+  __m256d pointX = _mm256_set1_pd(xi);
+  __m256d pointY = _mm256_set1_pd(yi);
+  __m256d pointZ = _mm256_set1_pd(zi);
+  __m256d softening = _mm256_set1_pd(softening2);
+  __m256d accX = _mm256_setzero_pd(), accY = accX, accZ = accX;
+
+  for (size_t j = 0; j < vectorEnd; j += width) {
+    addPull(_mm256_sub_pd(_mm256_loadu_pd(x + j), pointX),
+            _mm256_sub_pd(_mm256_loadu_pd(y + j), pointY),
+            _mm256_sub_pd(_mm256_loadu_pd(z + j), pointZ),
+            _mm256_loadu_pd(mass + j), softening, accX, accY, accZ);
+  }
+  if (vectorEnd < count) {
+    __m256i lanes = _mm256_castpd_si256(
+        _mm256_cmp_pd(_mm256_set_pd(3, 2, 1, 0),
+                      _mm256_set1_pd(double(count - vectorEnd)), _CMP_LT_OQ));
+    const size_t j = vectorEnd;
+    addPull(_mm256_sub_pd(_mm256_maskload_pd(x + j, lanes), pointX),
+            _mm256_sub_pd(_mm256_maskload_pd(y + j, lanes), pointY),
+            _mm256_sub_pd(_mm256_maskload_pd(z + j, lanes), pointZ),
+            _mm256_maskload_pd(mass + j, lanes), softening, accX, accY, accZ);
+  }
+
+  sumX = horizontalSum(accX);
+  sumY = horizontalSum(accY);
+  sumZ = horizontalSum(accZ);
+}
+#else
+// Function to add the pull of count point masses on the point (xi, yi, zi)
+void sumPull(const double *x, const double *y, const double *z,
+             const double *mass, size_t count, double xi, double yi,
+             double zi, double softening2, double &sumX, double &sumY,
+             double &sumZ) {
+  sumX = 0;
+  sumY = 0;
+  sumZ = 0;
+  sumPullScalar(x, y, z, mass, 0, count, xi, yi, zi, softening2, sumX,
+                sumY, sumZ);
+}
+#endif
+
+// Define the values of a body in ensembleLanes independent systems, each
+// pointer addressing them in consecutive lanes
+struct LaneBody {
+  const double *x, *y, *z, *mass;
+  double *ax, *ay, *az;
+};
+
+// Function to add the mutual pull of the bodies i and j of the lanes
+// [begin, ensembleLanes). The sums are added without the gravitational
+// constant
+void pullLanesScalar(const LaneBody &i, const LaneBody &j, size_t begin) {
+  for (size_t l = begin; l < ensembleLanes; l++) {
+    double dx = j.x[l] - i.x[l];
+    double dy = j.y[l] - i.y[l];
+    double dz = j.z[l] - i.z[l];
+    double r2 = dx * dx + dy * dy + dz * dz;
+    if (r2 > 0) {
+      double inverseR = 1 / std::sqrt(r2);
+      double inverseR3 = inverseR * inverseR * inverseR;
+      i.ax[l] += j.mass[l] * inverseR3 * dx;
+      i.ay[l] += j.mass[l] * inverseR3 * dy;
+      i.az[l] += j.mass[l] * inverseR3 * dz;
+      j.ax[l] -= i.mass[l] * inverseR3 * dx;
+      j.ay[l] -= i.mass[l] * inverseR3 * dy;
+      j.az[l] -= i.mass[l] * inverseR3 * dz;
+    }
+  }
+}
+
+#if defined(__AVX512F__)
+// Function to add the mutual pull of the bodies i and j of ensembleLanes
+// systems, 8 systems at a time
+void pullLanes(const LaneBody &i, const LaneBody &j) {
+  const size_t width = 8;
+  __m512d zero = _mm512_setzero_pd();
+  for (size_t l = 0; l + width <= ensembleLanes; l += width) {
+    __m512d dx =
+        _mm512_sub_pd(_mm512_loadu_pd(j.x + l), _mm512_loadu_pd(i.x + l));
+    __m512d dy =
+        _mm512_sub_pd(_mm512_loadu_pd(j.y + l), _mm512_loadu_pd(i.y + l));
+    __m512d dz =
+        _mm512_sub_pd(_mm512_loadu_pd(j.z + l), _mm512_loadu_pd(i.z + l));
+    __m512d r2 = _mm512_fmadd_pd(
+        dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+    __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+    __m512d inverseR = inverseSqrt(r2, valid);
+    __m512d inverseR3 =
+        _mm512_mul_pd(_mm512_mul_pd(inverseR, inverseR), inverseR);
+    __m512d fx = _mm512_mul_pd(inverseR3, dx);
+    __m512d fy = _mm512_mul_pd(inverseR3, dy);
+    __m512d fz = _mm512_mul_pd(inverseR3, dz);
+    __m512d massI = _mm512_loadu_pd(i.mass + l);
+    __m512d massJ = _mm512_loadu_pd(j.mass + l);
+    _mm512_storeu_pd(i.ax + l,
+                     _mm512_fmadd_pd(massJ, fx, _mm512_loadu_pd(i.ax + l)));
+    _mm512_storeu_pd(i.ay + l,
+                     _mm512_fmadd_pd(massJ, fy, _mm512_loadu_pd(i.ay + l)));
+    _mm512_storeu_pd(i.az + l,
+                     _mm512_fmadd_pd(massJ, fz, _mm512_loadu_pd(i.az + l)));
+    _mm512_storeu_pd(j.ax + l,
+                     _mm512_fnmadd_pd(massI, fx, _mm512_loadu_pd(j.ax + l)));
+    _mm512_storeu_pd(j.ay + l,
+                     _mm512_fnmadd_pd(massI, fy, _mm512_loadu_pd(j.ay + l)));
+    _mm512_storeu_pd(j.az + l,
+                     _mm512_fnmadd_pd(massI, fz, _mm512_loadu_pd(j.az + l)));
+  }
+  pullLanesScalar(i, j, ensembleLanes / width * width);
+}
+#elif defined(__AVX__)
+// Function to add the mutual pull of the bodies i and j of ensembleLanes
+// systems, 4 systems at a time
+void pullLanes(const LaneBody &i, const LaneBody &j) {
+  const size_t width = 4;
+  __m256d one = _mm256_set1_pd(1);
+  __m256d zero = _mm256_setzero_pd();
+  for (size_t l = 0; l + width <= ensembleLanes; l += width) {
+    __m256d dx =
+        _mm256_sub_pd(_mm256_loadu_pd(j.x + l), _mm256_loadu_pd(i.x + l));
+    __m256d dy =
+        _mm256_sub_pd(_mm256_loadu_pd(j.y + l), _mm256_loadu_pd(i.y + l));
+    __m256d dz =
+        _mm256_sub_pd(_mm256_loadu_pd(j.z + l), _mm256_loadu_pd(i.z + l));
+    __m256d r2 = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+        _mm256_mul_pd(dz, dz));
+    __m256d valid = _mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+    __m256d inverseR =
+        _mm256_and_pd(valid, _mm256_div_pd(one, _mm256_sqrt_pd(r2)));
+    __m256d inverseR3 =
+        _mm256_mul_pd(_mm256_mul_pd(inverseR, inverseR), inverseR);
+    __m256d fx = _mm256_mul_pd(inverseR3, dx);
+    __m256d fy = _mm256_mul_pd(inverseR3, dy);
+    __m256d fz = _mm256_mul_pd(inverseR3, dz);
+    __m256d massI = _mm256_loadu_pd(i.mass + l);
+    __m256d massJ = _mm256_loadu_pd(j.mass + l);
+    _mm256_storeu_pd(i.ax + l, _mm256_add_pd(_mm256_loadu_pd(i.ax + l),
+                                             _mm256_mul_pd(massJ, fx)));
+    _mm256_storeu_pd(i.ay + l, _mm256_add_pd(_mm256_loadu_pd(i.ay + l),
+                                             _mm256_mul_pd(massJ, fy)));
+    _mm256_storeu_pd(i.az + l, _mm256_add_pd(_mm256_loadu_pd(i.az + l),
+                                             _mm256_mul_pd(massJ, fz)));
+    _mm256_storeu_pd(j.ax + l, _mm256_sub_pd(_mm256_loadu_pd(j.ax + l),
+                                             _mm256_mul_pd(massI, fx)));
+    _mm256_storeu_pd(j.ay + l, _mm256_sub_pd(_mm256_loadu_pd(j.ay + l),
+                                             _mm256_mul_pd(massI, fy)));
+    _mm256_storeu_pd(j.az + l, _mm256_sub_pd(_mm256_loadu_pd(j.az + l),
+                                             _mm256_mul_pd(massI, fz)));
+  }
+  pullLanesScalar(i, j, ensembleLanes / width * width);
+}
+#else
+// Function to add the mutual pull of the bodies i and j of ensembleLanes
+// systems
+void pullLanes(const LaneBody &i, const LaneBody &j) {
+  pullLanesScalar(i, j, 0);
+}
+#endif
+
+// Function to compute the gravitational acceleration of the bodies
+// [begin, end) due to every other body of the system, softened by the given
+// length
+void computeAccelerationsDirect(BodySystem &system, double softening,
+                                size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    double sumX, sumY, sumZ;
+    sumPull(system.x.data(), system.y.data(), system.z.data(),
+            system.mass.data(), system.count, system.x[i], system.y[i],
+            system.z[i], softening * softening, sumX, sumY, sumZ);
+    system.ax[i] = gravitationalConstant * sumX;
+    system.ay[i] = gravitationalConstant * sumY;
+    system.az[i] = gravitationalConstant * sumZ;
+  }
+}
+
+#endif
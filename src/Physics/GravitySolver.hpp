@@ -0,0 +1,39 @@
+#ifndef GRAVITY_SOLVER_HPP
+#define GRAVITY_SOLVER_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "BarnesHut.hpp"
+#include "BodySystem.hpp"
+#include "Gravity.hpp"
+
+// Methods available to compute the gravitational accelerations
+enum SolverKind { DIRECT_SUM, BARNES_HUT };
+
+// Define a structure for holding the chosen method and its persistent state
+struct GravitySolver {
+  SolverKind kind = DIRECT_SUM;
+  float theta = 0.5; // opening angle of the Barnes-Hut approximation
+  double softening = 0; // added in quadrature to every distance, in meters
+  Octree tree;
+};
+
+// Function to compute the gravitational acceleration of every body with the
+// chosen method, using the workers of the pool
+void computeAccelerations(GravitySolver &solver, BodySystem &system,
+                          ThreadPool &pool) {
+  switch (solver.kind) {
+  case DIRECT_SUM:
+    parallelFor(pool, 0, system.count, chunkSizeFor(pool, system.count, 16),
+                [&](size_t begin, size_t end, unsigned int) {
+                  computeAccelerationsDirect(system, solver.softening, begin,
+                                             end);
+                });
+    break;
+  case BARNES_HUT:
+    computeAccelerationsBarnesHut(solver.tree, system, solver.theta,
+                                  solver.softening, pool);
+    break;
+  }
+}
+
+#endif
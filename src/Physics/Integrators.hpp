@@ -0,0 +1,246 @@
+#ifndef INTEGRATORS_HPP
+#define INTEGRATORS_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "../Profiling/Profiler.hpp"
+#include "BodySystem.hpp"
+#include "Collisions.hpp"
+#include "Ephemeris.hpp"
+#include "GravitySolver.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Schemes available to advance the bodies in time
+enum IntegratorKind {
+  SEMI_IMPLICIT_EULER, // first order, one force evaluation per step
+  LEAPFROG,            // second order kick-drift-kick (velocity Verlet)
+  YOSHIDA4,            // fourth order, three force evaluations per step
+  ADAPTIVE_LEAPFROG    // leapfrog with the step chosen from the accelerations
+};
+
+// Define a structure for holding the chosen scheme and its state between
+// steps
+struct Integrator {
+  IntegratorKind kind = LEAPFROG;
+  double timestep = 1000;   // fixed step, or largest step of adaptive schemes
+  double accuracy = 0.01;   // fraction of the acceleration time scale per step
+  double minTimestep = 1;   // smallest step of adaptive schemes
+  int maxRefinement = 16;   // adaptive steps are timestep / 2^k, k <= this
+  double time = 0;          // simulated time, in seconds
+  double adaptiveStep = 0;  // last step chosen by the adaptive scheme
+  long forceEvaluations = 0;
+  long steps = 0;           // steps taken, which an ephemeris jump is not
+  // Whether ax, ay and az match the current positions. It must be cleared
+  // whenever the bodies are changed from outside the integrator
+  bool accelerationsValid = false;
+  BodyArray previousAx, previousAy, previousAz;
+  Ephemeris ephemeris; // bodies placed on their orbits instead of integrated
+  Collisions collisions; // merges the bodies touching during a step
+};
+
+// Function to evaluate the accelerations at the current positions
+void evaluateForces(Integrator &integrator, GravitySolver &solver,
+                    BodySystem &system, ThreadPool &pool) {
+  ProfileScope scope(PROFILE_FORCES);
+  computeAccelerations(solver, system, pool);
+  holdEphemerisBodies(integrator.ephemeris, system);
+  integrator.forceEvaluations++;
+  integrator.accelerationsValid = true;
+}
+
+// Function to change every velocity by its acceleration over dt
+void kick(BodySystem &system, double dt, ThreadPool &pool) {
+  parallelFor(pool, 0, system.count, chunkSizeFor(pool, system.count, 1024),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  system.vx[i] += system.ax[i] * dt;
+                  system.vy[i] += system.ay[i] * dt;
+                  system.vz[i] += system.az[i] * dt;
+                }
+              });
+}
+
+// Function to move every body along its velocity over dt
+void drift(BodySystem &system, double dt, ThreadPool &pool) {
+  parallelFor(pool, 0, system.count, chunkSizeFor(pool, system.count, 1024),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  system.x[i] += system.vx[i] * dt;
+                  system.y[i] += system.vy[i] * dt;
+                  system.z[i] += system.vz[i] * dt;
+                }
+              });
+}
+
+// Function to put the bodies of the ephemeris on their orbits at the time
+// reached by a drift, which moved them along their velocity
+void followEphemeris(Integrator &integrator, BodySystem &system,
+                     ThreadPool &pool, double time) {
+  if (integrator.ephemeris.count > 0 ||
+      !integrator.ephemeris.lineBodies.empty()) {
+    placeEphemerisBodies(integrator.ephemeris, system, time, pool);
+  }
+}
+
+// Function to take one semi-implicit Euler step
+void stepSemiImplicitEuler(Integrator &integrator, GravitySolver &solver,
+                           BodySystem &system, ThreadPool &pool, double dt) {
+  evaluateForces(integrator, solver, system, pool);
+  kick(system, dt, pool);
+  drift(system, dt, pool);
+  followEphemeris(integrator, system, pool, integrator.time + dt);
+  // The accelerations belong to the positions before the drift
+  integrator.accelerationsValid = false;
+}
+
+// Function to take one kick-drift-kick leapfrog step. The accelerations of
+// the end of a step are reused at the start of the next one, so each step
+// costs a single force evaluation
+void stepLeapfrog(Integrator &integrator, GravitySolver &solver,
+                  BodySystem &system, ThreadPool &pool, double dt) {
+  if (!integrator.accelerationsValid) {
+    evaluateForces(integrator, solver, system, pool);
+  }
+  kick(system, dt / 2, pool);
+  drift(system, dt, pool);
+  followEphemeris(integrator, system, pool, integrator.time + dt);
+  evaluateForces(integrator, solver, system, pool);
+  kick(system, dt / 2, pool);
+}
+
+// Function to get the fractions of a step of Yoshida's fourth order scheme
+// taken by its four drifts and its three kicks. The scheme is a composition
+// of three leapfrog steps with weights w1, w0, w1
+void yoshida4Weights(double driftWeights[4], double kickWeights[3]) {
+  const double cubeRoot2 = std::cbrt(2.0);
+  const double w1 = 1 / (2 - cubeRoot2);
+  const double w0 = -cubeRoot2 / (2 - cubeRoot2);
+  driftWeights[0] = driftWeights[3] = w1 / 2;
+  driftWeights[1] = driftWeights[2] = (w0 + w1) / 2;
+  kickWeights[0] = kickWeights[2] = w1;
+  kickWeights[1] = w0;
+}
+
+// Function to take one step of Yoshida's fourth order scheme
+void stepYoshida4(Integrator &integrator, GravitySolver &solver,
+                  BodySystem &system, ThreadPool &pool, double dt) {
+  double driftWeights[4], kickWeights[3];
+  yoshida4Weights(driftWeights, kickWeights);
+
+  double elapsed = 0;
+  for (int k = 0; k < 3; k++) {
+    drift(system, driftWeights[k] * dt, pool);
+    elapsed += driftWeights[k] * dt;
+    followEphemeris(integrator, system, pool, integrator.time + elapsed);
+    evaluateForces(integrator, solver, system, pool);
+    kick(system, kickWeights[k] * dt, pool);
+  }
+  drift(system, driftWeights[3] * dt, pool);
+  followEphemeris(integrator, system, pool, integrator.time + dt);
+  integrator.accelerationsValid = false;
+}
+
+// Function to choose the next adaptive step from the time scale on which the
+// accelerations change, |a| / |da/dt|, estimated from the last two force
+// evaluations. The step is a power of two fraction of the largest one
+double chooseAdaptiveStep(Integrator &integrator, const BodySystem &system,
+                          double lastStep) {
+  double scale = INFINITY;
+  for (size_t i = 0; i < system.count; i++) {
+    double jerkX = (system.ax[i] - integrator.previousAx[i]) / lastStep;
+    double jerkY = (system.ay[i] - integrator.previousAy[i]) / lastStep;
+    double jerkZ = (system.az[i] - integrator.previousAz[i]) / lastStep;
+    double jerk2 = jerkX * jerkX + jerkY * jerkY + jerkZ * jerkZ;
+    double acceleration2 = system.ax[i] * system.ax[i] +
+                           system.ay[i] * system.ay[i] +
+                           system.az[i] * system.az[i];
+    if (jerk2 > 0) {
+      scale = std::min(scale, std::sqrt(acceleration2 / jerk2));
+    }
+  }
+
+  double wanted = std::max(integrator.accuracy * scale, integrator.minTimestep);
+  double step = integrator.timestep;
+  for (int k = 0; k < integrator.maxRefinement && step > wanted; k++) {
+    step /= 2;
+  }
+  return step;
+}
+
+// Function to take one adaptive leapfrog step of at most maxStep in the given
+// way of time, returning its length. The varying step makes it lose the exact
+// symplecticity of the fixed leapfrog, in exchange for long steps where
+// nothing happens quickly
+double stepAdaptiveLeapfrog(Integrator &integrator, GravitySolver &solver,
+                            BodySystem &system, ThreadPool &pool,
+                            double maxStep, double way) {
+  if (!integrator.accelerationsValid) {
+    evaluateForces(integrator, solver, system, pool);
+    // Start cautiously, since the change of the accelerations is unknown
+    integrator.adaptiveStep =
+        integrator.timestep / (1 << std::min(integrator.maxRefinement, 8));
+  }
+
+  double dt = std::min(integrator.adaptiveStep, maxStep);
+  integrator.previousAx.assign(system.ax.begin(), system.ax.end());
+  integrator.previousAy.assign(system.ay.begin(), system.ay.end());
+  integrator.previousAz.assign(system.az.begin(), system.az.end());
+
+  kick(system, way * dt / 2, pool);
+  drift(system, way * dt, pool);
+  followEphemeris(integrator, system, pool, integrator.time + way * dt);
+  evaluateForces(integrator, solver, system, pool);
+  kick(system, way * dt / 2, pool);
+
+  integrator.adaptiveStep = chooseAdaptiveStep(integrator, system, dt);
+  return dt;
+}
+
+// Function to advance the bodies by the given duration, which is negative to
+// go backwards in time. When every body follows the ephemeris, they are
+// placed at the end of the duration at once, however long it is
+void advance(Integrator &integrator, GravitySolver &solver,
+             BodySystem &system, ThreadPool &pool, double duration) {
+  if (system.count > 0 &&
+      ephemerisCoversSystem(integrator.ephemeris, system)) {
+    integrator.time += duration;
+    placeEphemerisBodies(integrator.ephemeris, system, integrator.time, pool);
+    integrator.accelerationsValid = false;
+    return;
+  }
+
+  double way = duration < 0 ? -1 : 1;
+  double remaining = std::fabs(duration);
+
+  while (remaining > 0) {
+    double dt;
+    if (integrator.kind == ADAPTIVE_LEAPFROG) {
+      dt = stepAdaptiveLeapfrog(integrator, solver, system, pool, remaining,
+                                way);
+    } else {
+      dt = std::min(integrator.timestep, remaining);
+      switch (integrator.kind) {
+      case SEMI_IMPLICIT_EULER:
+        stepSemiImplicitEuler(integrator, solver, system, pool, way * dt);
+        break;
+      case LEAPFROG:
+        stepLeapfrog(integrator, solver, system, pool, way * dt);
+        break;
+      default:
+        stepYoshida4(integrator, solver, system, pool, way * dt);
+        break;
+      }
+    }
+
+    remaining -= dt;
+    integrator.time += way * dt;
+    integrator.steps++;
+    if (integrator.collisions.enabled &&
+        resolveCollisions(integrator.collisions, system, way * dt, pool) > 0) {
+      // The survivors moved and gained mass
+      integrator.accelerationsValid = false;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef KEPLER_HPP
+#define KEPLER_HPP
+
+#include <cmath>
+#include <cstddef>
+
+// Define the Keplerian elements of a closed orbit around a parent body. The
+// reference plane is the XZ plane of the scene, with y up, and prograde
+// orbits turn from the x axis toward the z axis
+struct OrbitalElements {
+  double semiMajorAxis; // in meters
+  double eccentricity;  // in [0, 1)
+  double inclination;   // from the XZ plane, in radians
+  double ascendingNode; // longitude, from the x axis toward z, in radians
+  double periapsis;     // argument, from the ascending node, in radians
+  double meanAnomaly;   // at the epoch, in radians
+};
+
+// Function to solve Kepler's equation M = E - e sin E for the eccentric
+// anomaly E, with Newton's method
+double solveKepler(double meanAnomaly, double eccentricity) {
+  double m = std::remainder(meanAnomaly, 2 * M_PI);
+  // Danby's start converges for every eccentricity below one
+  double e = m + std::copysign(0.85, std::sin(m)) * eccentricity;
+  for (int i = 0; i < 50; i++) {
+    double step = (e - eccentricity * std::sin(e) - m) /
+                  (1 - eccentricity * std::cos(e));
+    e -= step;
+    if (std::fabs(step) < 1e-15) {
+      break;
+    }
+  }
+  return e;
+}
+
+// Function to compute the sine and the cosine of an angle of a few turns at
+// most, without branches, so the loops calling it are vectorised. The angle
+// is reduced to a quarter turn around a multiple of pi / 2, in two parts so
+// the reduction stays exact, and both are evaluated with the polynomials of
+// the Cephes library, which are accurate to a unit in the last place there
+inline void sinCos(double angle, double &sine, double &cosine) {
+  const double halfPiHigh = 1.57079632673412561417e+00; // first 33 bits
+  const double halfPiLow = 6.07710050650619224932e-11;
+  double turns = std::nearbyint(angle * M_2_PI);
+  double r = (angle - turns * halfPiHigh) - turns * halfPiLow;
+  double r2 = r * r;
+  double s =
+      r + r * r2 *
+              (-1.66666666666666307295e-1 +
+               r2 * (8.33333333332211858878e-3 +
+                     r2 * (-1.98412698295895385996e-4 +
+                           r2 * (2.75573136213857245213e-6 +
+                                 r2 * (-2.50507477628578072866e-8 +
+                                       r2 * 1.58962301576546568060e-10)))));
+  double c =
+      1 - 0.5 * r2 +
+      r2 * r2 *
+          (4.16666666666665929218e-2 +
+           r2 * (-1.38888888888730564116e-3 +
+                 r2 * (2.48015872888517045348e-5 +
+                       r2 * (-2.75573141792967388112e-7 +
+                             r2 * (2.08757008419747316778e-9 +
+                                   r2 * -1.13585365213876817300e-11)))));
+  // Each quarter turn swaps the sine and the cosine and changes a sign
+  int quadrant = (int)turns & 3;
+  sine = (quadrant & 1) ? c : s;
+  cosine = (quadrant & 1) ? s : c;
+  sine = (quadrant & 2) ? -sine : sine;
+  cosine = ((quadrant + 1) & 2) ? -cosine : cosine;
+}
+
+// Function to solve Kepler's equation for many orbits at once, with every
+// orbit taking the same Newton steps until all of them are negligible.
+// The loops have no branches, so the orbits are solved in vector lanes. The
+// mean anomalies must be within [-pi, pi], and the sine and the cosine of
+// the eccentric anomalies are returned with them
+void solveKeplerLanes(const double *meanAnomaly, const double *eccentricity,
+                      size_t count, double *anomaly, double *sine,
+                      double *cosine) {
+  // Danby's start converges for every eccentricity below one
+  for (size_t i = 0; i < count; i++) {
+    double s, c;
+    sinCos(meanAnomaly[i], s, c);
+    anomaly[i] = meanAnomaly[i] + std::copysign(0.85, s) * eccentricity[i];
+  }
+  for (int iteration = 0; iteration < 50; iteration++) {
+    int settled = 1;
+    for (size_t i = 0; i < count; i++) {
+      double s, c;
+      sinCos(anomaly[i], s, c);
+      double step = (anomaly[i] - eccentricity[i] * s - meanAnomaly[i]) /
+                    (1 - eccentricity[i] * c);
+      anomaly[i] -= step;
+      settled &= std::fabs(step) < 1e-14;
+    }
+    if (settled) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    sinCos(anomaly[i], sine[i], cosine[i]);
+  }
+}
+
+// Function to compute the position and the velocity, relative to the parent,
+// of a body on an orbit. mu is the gravitational constant times the masses
+// of the parent and of the body
+void elementsToState(const OrbitalElements &elements, double mu,
+                     double position[3], double velocity[3]) {
+  double a = elements.semiMajorAxis, e = elements.eccentricity;
+  double anomaly = solveKepler(elements.meanAnomaly, e);
+  double cosE = std::cos(anomaly), sinE = std::sin(anomaly);
+  double minorRatio = std::sqrt(1 - e * e);
+  double anomalyRate = std::sqrt(mu / (a * a * a)) / (1 - e * cosE);
+
+  // Coordinates in the plane of the orbit, periapsis along the first axis
+  double p = a * (cosE - e), q = a * minorRatio * sinE;
+  double vp = -a * sinE * anomalyRate, vq = a * minorRatio * cosE * anomalyRate;
+
+  // Axes of the orbit plane, rotated by the node, the inclination and the
+  // argument of periapsis. The third component of each is out of the plane
+  double cosNode = std::cos(elements.ascendingNode);
+  double sinNode = std::sin(elements.ascendingNode);
+  double cosI = std::cos(elements.inclination);
+  double sinI = std::sin(elements.inclination);
+  double cosW = std::cos(elements.periapsis);
+  double sinW = std::sin(elements.periapsis);
+  double axisP[3] = {cosNode * cosW - sinNode * sinW * cosI,
+                     sinNode * cosW + cosNode * sinW * cosI, sinW * sinI};
+  double axisQ[3] = {-cosNode * sinW - sinNode * cosW * cosI,
+                     -sinNode * sinW + cosNode * cosW * cosI, cosW * sinI};
+
+  // The reference plane is XZ and its normal is y
+  const int sceneAxes[3] = {0, 2, 1};
+  for (int k = 0; k < 3; k++) {
+    position[sceneAxes[k]] = p * axisP[k] + q * axisQ[k];
+    velocity[sceneAxes[k]] = vp * axisP[k] + vq * axisQ[k];
+  }
+}
+
+#endif
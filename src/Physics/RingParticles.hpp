@@ -0,0 +1,247 @@
+#ifndef RING_PARTICLES_HPP
+#define RING_PARTICLES_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "BodySystem.hpp"
+#include "Gravity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Steps of the ring kernel per orbit of the innermost particles
+const int ringStepsPerOrbit = 64;
+// Most steps a ring takes to catch up with the simulated time. A longer jump
+// stretches the steps, up to ringStretch times their length
+const int ringStepLimit = 64;
+// Longest stretch of the steps, which keeps the leapfrog stable. The time
+// even the stretched steps do not cover is skipped, and counted
+const double ringStretch = 4;
+// Particles stepped together, their states held in double precision
+const size_t ringBlock = 256;
+// Positions reach this many outer radii before they are clamped
+const double ringReach = 4;
+
+// Define a moon pulling on the particles of a ring. Its position is relative
+// to the body of the ring, in meters, and is updated before every advance
+struct RingMoon {
+  int body;        // index of the drawn body
+  double mu;       // gravitational constant times its mass
+  double softening2; // squared, so particles can cross it without a kick
+  double x, y, z;
+};
+
+// Define a population of test particles orbiting a body, pulled by it and by
+// a few of its moons, but not by each other nor by anything else, and
+// pulling on nothing. The positions are fixed-point numbers relative to the
+// body, interleaved so they are drawn as they are, and the velocities are in
+// single precision, so a particle takes 24 bytes
+struct RingParticles {
+  int body;           // index of the drawn body it orbits
+  size_t count = 0;
+  double time = 0;    // simulated time the particles are at
+  double mu = 0;      // gravitational constant times the mass of the body
+  double quantum = 0; // meters per unit of the positions
+  double step = 0;    // longest step of the kernel, in seconds
+  double reach = 0;   // radius around the body holding every particle
+  double skipped = 0; // simulated seconds the steps could not cover
+  std::vector<int32_t> positions; // x, y, z of each particle
+  std::vector<float> vx, vy, vz;
+  std::vector<RingMoon> moons;
+};
+
+// Function to fill a ring with particles on nearly circular orbits in the XZ
+// plane of its body, spread evenly over the area between the inner and the
+// outer radius (in meters). Their epicycles, in and out of the plane, are
+// about the thickness. The same seed always yields the same ring
+void createRingParticles(RingParticles &ring, int body, double mass,
+                         double inner, double outer, double thickness,
+                         size_t count, unsigned int seed, double time) {
+  ring = RingParticles();
+  ring.body = body;
+  ring.time = time;
+  ring.mu = gravitationalConstant * mass;
+  // A body without mass holds nothing on an orbit
+  if (!(ring.mu > 0)) {
+    return;
+  }
+  ring.count = count;
+  ring.reach = outer + thickness;
+  ring.quantum = ringReach * outer / INT32_MAX;
+  ring.step = 2 * M_PI * std::sqrt(inner * inner * inner / ring.mu) /
+              ringStepsPerOrbit;
+  ring.positions.resize(3 * count);
+  ring.vx.resize(count);
+  ring.vy.resize(count);
+  ring.vz.resize(count);
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> area(inner * inner, outer * outer);
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  std::normal_distribution<double> epicycle(0, thickness / 2);
+  for (size_t i = 0; i < count; i++) {
+    double r = std::sqrt(area(generator)), theta = angle(generator);
+    double speed = std::sqrt(ring.mu / r);
+    // Velocities across the orbit take the particle as far as this
+    double radial = speed * epicycle(generator) / r;
+    double vertical = speed * epicycle(generator) / r;
+    double c = std::cos(theta), s = std::sin(theta);
+    ring.positions[3 * i] = std::lround(r * c / ring.quantum);
+    ring.positions[3 * i + 1] = 0;
+    ring.positions[3 * i + 2] = std::lround(r * s / ring.quantum);
+    ring.vx[i] = radial * c - speed * s;
+    ring.vy[i] = vertical;
+    ring.vz[i] = radial * s + speed * c;
+  }
+}
+
+// Function to add a moon pulling on a ring, given its mass and the radius
+// within which its pull is softened
+void addRingMoon(RingParticles &ring, int body, double mass,
+                 double softening) {
+  ring.moons.push_back(RingMoon{body, gravitationalConstant * mass,
+                                softening * softening, 0, 0, 0});
+}
+
+// Function to replace count squared distances by the inverse of their cubes,
+// 8 or 4 at a time with the vector instructions of the processor. Every
+// distance must be positive
+void inverseCubes(double *r2, size_t count) {
+  size_t i = 0;
+#if defined(__AVX512F__)
+  for (; i + 8 <= count; i += 8) {
+    __m512d inverseR = inverseSqrt(_mm512_loadu_pd(r2 + i), 0xFF);
+    _mm512_storeu_pd(
+        r2 + i, _mm512_mul_pd(_mm512_mul_pd(inverseR, inverseR), inverseR));
+  }
+#elif defined(__AVX__)
+  __m256d one = _mm256_set1_pd(1);
+  for (; i + 4 <= count; i += 4) {
+    __m256d inverseR =
+        _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_loadu_pd(r2 + i)));
+    _mm256_storeu_pd(
+        r2 + i, _mm256_mul_pd(_mm256_mul_pd(inverseR, inverseR), inverseR));
+  }
+#endif
+  for (; i < count; i++) {
+    double inverseR = 1 / std::sqrt(r2[i]);
+    r2[i] = inverseR * inverseR * inverseR;
+  }
+}
+
+// Function to advance the particles [begin, end) of a ring by a number of
+// leapfrog steps of duration dt. Their states are unpacked to double
+// precision once, then every loop runs over the whole block without
+// branches, so the particles are stepped in vector lanes
+void advanceRingBlock(RingParticles &ring, double dt, int steps, size_t begin,
+                      size_t end) {
+  alignas(simdAlignment) double x[ringBlock], y[ringBlock], z[ringBlock];
+  alignas(simdAlignment) double vx[ringBlock], vy[ringBlock], vz[ringBlock];
+  alignas(simdAlignment) double ax[ringBlock], ay[ringBlock], az[ringBlock];
+  alignas(simdAlignment) double pull[ringBlock];
+  size_t n = end - begin;
+  int32_t *position = &ring.positions[3 * begin];
+  for (size_t i = 0; i < n; i++) {
+    x[i] = position[3 * i] * ring.quantum;
+    y[i] = position[3 * i + 1] * ring.quantum;
+    z[i] = position[3 * i + 2] * ring.quantum;
+    vx[i] = ring.vx[begin + i];
+    vy[i] = ring.vy[begin + i];
+    vz[i] = ring.vz[begin + i];
+  }
+
+  // The particles are relative to the body, which the moons pull as well
+  double bodyX = 0, bodyY = 0, bodyZ = 0;
+  for (const RingMoon &moon : ring.moons) {
+    double r2 = moon.x * moon.x + moon.y * moon.y + moon.z * moon.z +
+                moon.softening2;
+    double pull = moon.mu / (r2 * std::sqrt(r2));
+    bodyX += pull * moon.x;
+    bodyY += pull * moon.y;
+    bodyZ += pull * moon.z;
+  }
+
+  double halfDt = dt / 2;
+  for (int step = 0; step < steps; step++) {
+    for (size_t i = 0; i < n; i++) {
+      x[i] += vx[i] * halfDt;
+      y[i] += vy[i] * halfDt;
+      z[i] += vz[i] * halfDt;
+      pull[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+    }
+    inverseCubes(pull, n);
+    for (size_t i = 0; i < n; i++) {
+      ax[i] = -ring.mu * pull[i] * x[i] - bodyX;
+      ay[i] = -ring.mu * pull[i] * y[i] - bodyY;
+      az[i] = -ring.mu * pull[i] * z[i] - bodyZ;
+    }
+    for (const RingMoon &moon : ring.moons) {
+      for (size_t i = 0; i < n; i++) {
+        double dx = moon.x - x[i], dy = moon.y - y[i], dz = moon.z - z[i];
+        pull[i] = dx * dx + dy * dy + dz * dz + moon.softening2;
+      }
+      inverseCubes(pull, n);
+      for (size_t i = 0; i < n; i++) {
+        ax[i] += moon.mu * pull[i] * (moon.x - x[i]);
+        ay[i] += moon.mu * pull[i] * (moon.y - y[i]);
+        az[i] += moon.mu * pull[i] * (moon.z - z[i]);
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      vx[i] += ax[i] * dt;
+      vy[i] += ay[i] * dt;
+      vz[i] += az[i] * dt;
+      x[i] += vx[i] * halfDt;
+      y[i] += vy[i] * halfDt;
+      z[i] += vz[i] * halfDt;
+    }
+  }
+
+  // Particles thrown out of the ring stop at the edge of the fixed-point range
+  double inverse = 1 / ring.quantum, limit = INT32_MAX;
+  for (size_t i = 0; i < n; i++) {
+    position[3 * i] = std::nearbyint(
+        std::max(-limit, std::min(limit, x[i] * inverse)));
+    position[3 * i + 1] = std::nearbyint(
+        std::max(-limit, std::min(limit, y[i] * inverse)));
+    position[3 * i + 2] = std::nearbyint(
+        std::max(-limit, std::min(limit, z[i] * inverse)));
+    ring.vx[begin + i] = vx[i];
+    ring.vy[begin + i] = vy[i];
+    ring.vz[begin + i] = vz[i];
+  }
+}
+
+// Function to advance a ring to the given simulated time, forward or
+// backward, with steps no longer than its own unless the jump needs more
+// than ringStepLimit of them. The blocks of particles are shared among the
+// workers of the pool, and each one is advanced through every step at once,
+// so it stays in the cache and is unpacked only once
+void advanceRingParticles(RingParticles &ring, double time, ThreadPool &pool) {
+  double gap = time - ring.time;
+  ring.time = time;
+  if (gap == 0 || ring.count == 0) {
+    return;
+  }
+  int steps = std::min(std::ceil(std::fabs(gap) / ring.step),
+                       (double)ringStepLimit);
+  double dt = std::fabs(gap) / steps;
+  if (dt > ringStretch * ring.step) {
+    dt = ringStretch * ring.step;
+    ring.skipped += std::fabs(gap) - steps * dt;
+  }
+  dt = std::copysign(dt, gap);
+
+  size_t blocks = (ring.count + ringBlock - 1) / ringBlock;
+  parallelFor(pool, 0, blocks, chunkSizeFor(pool, blocks, 1),
+              [&](size_t firstBlock, size_t lastBlock, unsigned int) {
+                for (size_t block = firstBlock; block < lastBlock; block++) {
+                  size_t begin = block * ringBlock;
+                  advanceRingBlock(ring, dt, steps, begin,
+                                   std::min(begin + ringBlock, ring.count));
+                }
+              });
+}
+
+#endif
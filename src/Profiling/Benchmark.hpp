@@ -0,0 +1,96 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Define a structure for the result of a benchmark. A run processes size
+// items (bodies, points, stars or frames), and the fastest run is kept, as
+// it is the least disturbed by the rest of the machine
+struct BenchmarkResult {
+  std::string name;
+  size_t size = 0;
+  long runs = 0;
+  double seconds = INFINITY; // fastest run
+
+  double nsPerItem() const { return seconds * 1e9 / size; }
+  double runsPerSecond() const { return 1 / seconds; }
+};
+
+// Function to time a run repeatedly, for at least minSeconds and at least
+// minRuns times, after a first run that warms up the caches
+template <typename Run>
+BenchmarkResult measure(const std::string &name, size_t size, Run run,
+                        double minSeconds = 0.5, long minRuns = 3) {
+  BenchmarkResult result;
+  result.name = name;
+  result.size = size;
+
+  run();
+  double total = 0;
+  while (total < minSeconds || result.runs < minRuns) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.seconds = std::min(result.seconds, elapsed.count());
+    total += elapsed.count();
+    result.runs++;
+  }
+  return result;
+}
+
+// Function to print the header of the benchmark table
+void printBenchmarkHeader(std::ostream &out) {
+  out << std::left << std::setw(28) << "Benchmark" << std::right
+      << std::setw(10) << "size" << std::setw(8) << "runs" << std::setw(14)
+      << "ms/run" << std::setw(14) << "ns/item" << std::setw(14) << "runs/s"
+      << std::endl;
+}
+
+// Function to print a benchmark result as a row of the table
+void printBenchmarkResult(const BenchmarkResult &result, std::ostream &out) {
+  out << std::left << std::setw(28) << result.name << std::right
+      << std::setw(10) << result.size << std::setw(8) << result.runs
+      << std::fixed << std::setprecision(3) << std::setw(14)
+      << result.seconds * 1e3 << std::setw(14) << result.nsPerItem()
+      << std::setw(14) << result.runsPerSecond() << std::defaultfloat
+      << std::endl;
+}
+
+// Function to write the benchmark results to a CSV file, one row per result.
+// Every row holds the date of the run and the given configuration, so the
+// files of several runs can be concatenated to follow the results over time
+bool writeBenchmarkCsv(const std::vector<BenchmarkResult> &results,
+                       const std::string &configuration,
+                       const std::string &path) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Could not create benchmark file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+  file << "date,configuration,benchmark,size,runs,seconds_per_run,"
+          "ns_per_item,runs_per_second\n";
+  file.precision(9);
+  for (const BenchmarkResult &result : results) {
+    file << date << "," << configuration << "," << result.name << ","
+         << result.size << "," << result.runs << "," << result.seconds << ","
+         << result.nsPerItem() << "," << result.runsPerSecond() << "\n";
+  }
+  return bool(file);
+}
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Sections of the physics tick and of the frame that are timed
+enum ProfileSection {
+  PROFILE_TICK,         // whole physics tick
+  PROFILE_FORCES,       // one force evaluation inside a tick
+  PROFILE_PUBLISH,      // copy of the bodies for the renderer
+  PROFILE_RING_STEPS,   // ring particles advanced with a physics tick
+  PROFILE_FRAME,        // whole scene drawing
+  PROFILE_STARS,        // star field pass
+  PROFILE_GRID,         // grid pass
+  PROFILE_TRAILS,       // orbit trails pass
+  PROFILE_BODIES,       // lit bodies pass
+  PROFILE_SMALL_BODIES, // batched small bodies pass
+  PROFILE_RINGS,        // ring particles pass
+  PROFILE_LINES,        // planet finder and Bezier curve pass
+  PROFILE_PRESENT,      // buffer swap, or frame readback when offscreen
+  PROFILE_SECTION_COUNT
+};
+
+const char *const profileSectionNames[PROFILE_SECTION_COUNT] = {
+    "tick",  "forces", "publish", "ring steps", "frame",
+    "stars", "grid",   "trails",  "bodies",     "small bodies",
+    "rings", "lines",  "present"};
+
+// Quantities counted once per frame, kept like the timings of the sections
+enum ProfileCounter {
+  PROFILE_DRAWN,  // objects passing the frustum culling
+  PROFILE_CULLED, // objects skipped by the frustum culling
+  PROFILE_COUNTER_COUNT
+};
+
+const char *const profileCounterNames[PROFILE_COUNTER_COUNT] = {"drawn",
+                                                                "culled"};
+
+// Samples kept per section, which must be a power of two
+const uint64_t profileCapacity = 8192;
+
+// Define a structure for one timed run of a section, in nanoseconds since the
+// profiler started, or for one value of a counter, taken at start
+struct ProfileSample {
+  std::atomic<int64_t> start{0}, duration{0};
+};
+
+// Define a lock-free ring of the latest samples of a section. Each section is
+// only timed by one thread at a time, so the ring has a single writer, and
+// readers detect the samples overwritten while they copied them
+struct ProfileTrack {
+  std::atomic<uint64_t> reserved{0}; // samples whose writing has started
+  std::atomic<uint64_t> written{0};  // samples completely written
+  ProfileSample samples[profileCapacity];
+};
+
+// Define a structure holding the timings of every section. When it is
+// disabled, a timed scope costs a single relaxed load
+struct Profiler {
+  std::atomic<bool> enabled{false};
+  std::chrono::steady_clock::time_point epoch =
+      std::chrono::steady_clock::now();
+  ProfileTrack tracks[PROFILE_SECTION_COUNT];
+  ProfileTrack counters[PROFILE_COUNTER_COUNT];
+  std::vector<double> scratch; // durations being sorted by a reader
+};
+
+// Define a structure for the distribution of the latest durations of a
+// section, in milliseconds, or of the latest values of a counter
+struct ProfileStats {
+  size_t samples = 0;
+  double p50 = 0, p95 = 0, p99 = 0, max = 0;
+};
+
+// The timed sections are spread over the whole program, so the profiler is
+// shared by all of them
+Profiler profiler;
+
+// Function to get the nanoseconds elapsed since the profiler started
+int64_t profileClock(const Profiler &profiler) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - profiler.epoch)
+      .count();
+}
+
+// Function to add a sample to the ring of a section
+void recordSample(ProfileTrack &track, int64_t start, int64_t duration) {
+  uint64_t index = track.written.load(std::memory_order_relaxed);
+  track.reserved.store(index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  ProfileSample &sample = track.samples[index & (profileCapacity - 1)];
+  sample.start.store(start, std::memory_order_relaxed);
+  sample.duration.store(duration, std::memory_order_relaxed);
+  track.written.store(index + 1, std::memory_order_release);
+}
+
+// Function to record the value of a counter, if the profiler is enabled
+void recordCount(Profiler &profiler, ProfileCounter counter, int64_t value) {
+  if (profiler.enabled.load(std::memory_order_relaxed)) {
+    recordSample(profiler.counters[counter], profileClock(profiler), value);
+  }
+}
+
+// Define a scope whose run time is recorded as a sample of a section, if the
+// profiler is enabled when the scope starts
+struct ProfileScope {
+  ProfileSection section;
+  bool active;
+  int64_t start = 0;
+
+  explicit ProfileScope(ProfileSection section)
+      : section(section),
+        active(profiler.enabled.load(std::memory_order_relaxed)) {
+    if (active) {
+      start = profileClock(profiler);
+    }
+  }
+
+  ~ProfileScope() {
+    if (active) {
+      recordSample(profiler.tracks[section], start,
+                   profileClock(profiler) - start);
+    }
+  }
+};
+
+// Function to copy the latest samples of a track, at most count of them and
+// oldest first, skipping those overwritten during the copy. The durations
+// are divided by the unit
+void copySamples(const ProfileTrack &track, uint64_t count, double unit,
+                 std::vector<int64_t> *starts, std::vector<double> &durations) {
+  uint64_t end = track.written.load(std::memory_order_acquire);
+  uint64_t begin = end > count ? end - count : 0;
+  if (end - begin > profileCapacity) {
+    begin = end - profileCapacity;
+  }
+
+  size_t first = durations.size();
+  size_t firstStart = starts != nullptr ? starts->size() : 0;
+  for (uint64_t i = begin; i < end; i++) {
+    const ProfileSample &sample = track.samples[i & (profileCapacity - 1)];
+    if (starts != nullptr) {
+      starts->push_back(sample.start.load(std::memory_order_relaxed));
+    }
+    durations.push_back(sample.duration.load(std::memory_order_relaxed) /
+                        unit);
+  }
+
+  // The samples below the writer's reservation minus the capacity may have
+  // been overwritten while they were read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t reserved = track.reserved.load(std::memory_order_relaxed);
+  if (reserved > begin + profileCapacity) {
+    size_t overwritten =
+        std::min<uint64_t>(reserved - begin - profileCapacity, end - begin);
+    durations.erase(durations.begin() + first,
+                    durations.begin() + first + overwritten);
+    if (starts != nullptr) {
+      starts->erase(starts->begin() + firstStart,
+                    starts->begin() + firstStart + overwritten);
+    }
+  }
+}
+
+// Function to get the percentiles of the latest samples of a track, divided
+// by the unit
+ProfileStats trackStats(Profiler &profiler, const ProfileTrack &track,
+                        uint64_t window, double unit) {
+  ProfileStats stats;
+  std::vector<double> &durations = profiler.scratch;
+  durations.clear();
+  copySamples(track, window, unit, nullptr, durations);
+  stats.samples = durations.size();
+  if (durations.empty()) {
+    return stats;
+  }
+
+  std::sort(durations.begin(), durations.end());
+  auto percentile = [&](double p) {
+    return durations[std::min<size_t>(durations.size() - 1,
+                                      p * durations.size())];
+  };
+  stats.p50 = percentile(0.50);
+  stats.p95 = percentile(0.95);
+  stats.p99 = percentile(0.99);
+  stats.max = durations.back();
+  return stats;
+}
+
+// Function to get the percentiles of the latest durations of a section
+ProfileStats profileStats(Profiler &profiler, ProfileSection section,
+                          uint64_t window) {
+  return trackStats(profiler, profiler.tracks[section], window, 1e6);
+}
+
+// Function to get the percentiles of the latest values of a counter
+ProfileStats counterStats(Profiler &profiler, ProfileCounter counter,
+                          uint64_t window) {
+  return trackStats(profiler, profiler.counters[counter], window, 1);
+}
+
+// Function to print the percentiles of every timed section over all the
+// samples still held by the profiler
+void printProfileSummary(Profiler &profiler, std::ostream &out) {
+  out << "Section        samples      p50 ms      p95 ms      p99 ms"
+      << "      max ms" << std::endl;
+  for (int section = 0; section < PROFILE_SECTION_COUNT; section++) {
+    ProfileStats stats =
+        profileStats(profiler, ProfileSection(section), profileCapacity);
+    if (stats.samples == 0) {
+      continue;
+    }
+    std::string name = profileSectionNames[section];
+    name.resize(14, ' ');
+    out << name << std::setw(8) << stats.samples << std::fixed
+        << std::setprecision(3) << std::setw(12) << stats.p50
+        << std::setw(12) << stats.p95 << std::setw(12) << stats.p99
+        << std::setw(12) << stats.max << std::defaultfloat << std::endl;
+  }
+
+  bool header = false;
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+    ProfileStats stats =
+        counterStats(profiler, ProfileCounter(counter), profileCapacity);
+    if (stats.samples == 0) {
+      continue;
+    }
+    if (!header) {
+      out << "Counter        samples         p50         p95         p99"
+          << "         max" << std::endl;
+      header = true;
+    }
+    std::string name = profileCounterNames[counter];
+    name.resize(14, ' ');
+    out << name << std::setw(8) << stats.samples << std::setw(12)
+        << stats.p50 << std::setw(12) << stats.p95 << std::setw(12)
+        << stats.p99 << std::setw(12) << stats.max << std::endl;
+  }
+}
+
+// Function to write every sample still held by the profiler to a CSV file,
+// in the order they started. Counters leave the duration empty and give
+// their value in the count column
+bool writeProfileCsv(const Profiler &profiler, const std::string &path) {
+  struct Row {
+    int64_t start;
+    double value;
+    const char *name;
+    bool counter;
+  };
+  std::vector<Row> rows;
+  std::vector<int64_t> starts;
+  std::vector<double> durations;
+
+  for (int section = 0; section < PROFILE_SECTION_COUNT; section++) {
+    starts.clear();
+    durations.clear();
+    copySamples(profiler.tracks[section], profileCapacity, 1e6, &starts,
+                durations);
+    for (size_t i = 0; i < durations.size(); i++) {
+      rows.push_back(
+          {starts[i], durations[i], profileSectionNames[section], false});
+    }
+  }
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+    starts.clear();
+    durations.clear();
+    copySamples(profiler.counters[counter], profileCapacity, 1, &starts,
+                durations);
+    for (size_t i = 0; i < durations.size(); i++) {
+      rows.push_back(
+          {starts[i], durations[i], profileCounterNames[counter], true});
+    }
+  }
+  std::sort(rows.begin(), rows.end(),
+            [](const Row &a, const Row &b) { return a.start < b.start; });
+
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Could not create profile file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+  file << "section,start_ms,duration_ms,count\n";
+  for (const Row &row : rows) {
+    file << row.name << "," << row.start / 1e6 << ",";
+    if (row.counter) {
+      file << "," << row.value << "\n";
+    } else {
+      file << row.value << ",\n";
+    }
+  }
+  return bool(file);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef BODY_BATCH_HPP
+#define BODY_BATCH_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Simulation/SnapshotBuffer.hpp"
+#include "../Structs/Color.hpp"
+#include <GL/glut.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Define a structure for drawing many small bodies (asteroids, debris) as a
+// single stream of points. The vertex array and the buffer object keep their
+// capacity between frames, so only a count change reallocates them
+struct BodyBatch {
+  GLuint buffer = 0;
+  size_t bufferCapacity = 0; // in vertices
+  std::vector<GLfloat> vertices;
+  Color color{0.6, 0.5, 0.4};
+  GLfloat pointSize = 2;
+  GLfloat center[3] = {0, 0, 0}; // bounding sphere of the last fill
+  GLfloat radius = 0;
+};
+
+// Function to compute the bounding sphere of the batch vertices, from their
+// bounding box
+void boundBodyBatch(BodyBatch &batch) {
+  size_t count = batch.vertices.size() / 3;
+  GLfloat low[3] = {INFINITY, INFINITY, INFINITY};
+  GLfloat high[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = 0; i < count; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      low[axis] = std::min(low[axis], batch.vertices[3 * i + axis]);
+      high[axis] = std::max(high[axis], batch.vertices[3 * i + axis]);
+    }
+  }
+
+  batch.radius = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    batch.center[axis] = count > 0 ? (low[axis] + high[axis]) / 2 : 0;
+    GLfloat half = count > 0 ? (high[axis] - low[axis]) / 2 : 0;
+    batch.radius += half * half;
+  }
+  batch.radius = sqrt(batch.radius);
+}
+
+// Function to fill the batch with the bodies [first, end) of the snapshots,
+// interpolated as the hero bodies and converted to scene units
+void fillBodyBatch(BodyBatch &batch, const Snapshot &previous,
+                   const Snapshot &current, double factor, size_t first,
+                   double scale) {
+  size_t end = current.x.size();
+  size_t count = end > first ? end - first : 0;
+  batch.vertices.resize(count * 3);
+  GLfloat *vertex = batch.vertices.data();
+
+  if (factor < 1) {
+    for (size_t i = first; i < end; i++) {
+      *vertex++ = (previous.x[i] + factor * (current.x[i] - previous.x[i])) *
+                  scale;
+      *vertex++ = (previous.y[i] + factor * (current.y[i] - previous.y[i])) *
+                  scale;
+      *vertex++ = (previous.z[i] + factor * (current.z[i] - previous.z[i])) *
+                  scale;
+    }
+  } else {
+    for (size_t i = first; i < end; i++) {
+      *vertex++ = current.x[i] * scale;
+      *vertex++ = current.y[i] * scale;
+      *vertex++ = current.z[i] * scale;
+    }
+  }
+
+  boundBodyBatch(batch);
+}
+
+// Function to upload the batch and draw it with a single call
+void drawBodyBatch(BodyBatch &batch) {
+  size_t count = batch.vertices.size() / 3;
+  if (count == 0) {
+    return;
+  }
+
+  if (batch.buffer == 0) {
+    glGenBuffers(1, &batch.buffer);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, batch.buffer);
+  size_t bytes = batch.vertices.size() * sizeof(GLfloat);
+  if (count > batch.bufferCapacity) {
+    glBufferData(GL_ARRAY_BUFFER, bytes, batch.vertices.data(),
+                 GL_STREAM_DRAW);
+    batch.bufferCapacity = count;
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, batch.vertices.data());
+  }
+
+  glColor3f(batch.color.r, batch.color.g, batch.color.b);
+  glPointSize(batch.pointSize);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, 0);
+  glDrawArrays(GL_POINTS, 0, count);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glPointSize(1);
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef CAMERA_PATH_HPP
+#define CAMERA_PATH_HPP
+
+#include "../Structs/Coordinates.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Define a structure for a camera position along a scripted path
+struct CameraKey {
+  double time; // in seconds of the rendered video
+  Coordinates position;
+  GLfloat yaw, pitch; // in degrees, as the mouse controls
+};
+
+// Function to load a camera path. Each line holds "time x y z yaw pitch",
+// with increasing times, and lines starting with '#' are comments
+bool loadCameraPath(const std::string &path, std::vector<CameraKey> &keys) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Could not open camera path '" << path << "'." << std::endl;
+    return false;
+  }
+
+  keys.clear();
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream stream(line);
+    CameraKey key;
+    if (!(stream >> key.time >> key.position.x >> key.position.y >>
+          key.position.z >> key.yaw >> key.pitch) ||
+        (!keys.empty() && key.time <= keys.back().time)) {
+      std::cerr << "Invalid camera key at line " << lineNumber << " of '"
+                << path << "'." << std::endl;
+      return false;
+    }
+    keys.push_back(key);
+  }
+
+  if (keys.empty()) {
+    std::cerr << "Camera path '" << path << "' has no keys." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Function to get the camera along the path at a given time, linearly
+// interpolated between the surrounding keys
+CameraKey cameraAt(const std::vector<CameraKey> &keys, double time) {
+  if (time <= keys.front().time) {
+    return keys.front();
+  }
+  for (size_t i = 1; i < keys.size(); i++) {
+    if (time < keys[i].time) {
+      const CameraKey &from = keys[i - 1], &to = keys[i];
+      GLfloat f = (time - from.time) / (to.time - from.time);
+      return {time,
+              {from.position.x + f * (to.position.x - from.position.x),
+               from.position.y + f * (to.position.y - from.position.y),
+               from.position.z + f * (to.position.z - from.position.z)},
+              from.yaw + f * (to.yaw - from.yaw),
+              from.pitch + f * (to.pitch - from.pitch)};
+    }
+  }
+  return keys.back();
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef DRAWN_LIFTS_HPP
+#define DRAWN_LIFTS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Define the lifts of the bodies whose orbit passes inside their drawn
+// parent. The bodies are drawn far larger than they are, so such a body is
+// drawn further from its parent than it is, by the drawn radii of both, in
+// the direction it really has. A body is drawn moved with its parent. Only
+// the drawing changes: the simulation keeps the real positions. The bodies
+// are indexed as in the body system
+struct DrawnLifts {
+  std::vector<int> parents;      // parent of each body, or -1
+  std::vector<double> lifts;     // distance added, in scene units
+  std::vector<double> physical;  // x, y, z of the last position of each body
+  std::vector<double> shifts;    // x, y, z moved by the last lift
+};
+
+// Function to clear the lifts and make room for the given number of bodies
+void resetDrawnLifts(DrawnLifts &lifts, size_t count) {
+  lifts.parents.assign(count, -1);
+  lifts.lifts.assign(count, 0);
+  lifts.physical.assign(3 * count, 0);
+  lifts.shifts.assign(3 * count, 0);
+}
+
+// Function to lift a body if its orbit around its parent, given by its
+// position and velocity relative to the parent in meters and meters per
+// second, comes closer than the drawn radii of both
+void setDrawnLift(DrawnLifts &lifts, size_t body, int parent, double mu,
+                  double x, double y, double z, double vx, double vy,
+                  double vz, double radii, double scale) {
+  double r = std::sqrt(x * x + y * y + z * z);
+  double energy = (vx * vx + vy * vy + vz * vz) / 2 - mu / r;
+  double periapsis = r;
+  if (energy < 0) {
+    double a = -mu / (2 * energy);
+    double hx = y * vz - z * vy, hy = z * vx - x * vz, hz = x * vy - y * vx;
+    double e2 = 1 - (hx * hx + hy * hy + hz * hz) / (mu * a);
+    periapsis = a * (1 - std::sqrt(std::max(0.0, e2)));
+  }
+
+  lifts.parents[body] = parent;
+  lifts.lifts[body] = periapsis * scale < radii ? radii : 0;
+}
+
+// Function to turn the position of a body, in scene units, into the one it
+// is drawn at. The bodies must go parents first, so the parent of a body
+// already has its lift
+void liftPosition(DrawnLifts &lifts, size_t body, double &x, double &y,
+                  double &z) {
+  if (body >= lifts.lifts.size()) {
+    return;
+  }
+  double *physical = &lifts.physical[3 * body];
+  double *shift = &lifts.shifts[3 * body];
+  physical[0] = x;
+  physical[1] = y;
+  physical[2] = z;
+  shift[0] = shift[1] = shift[2] = 0;
+
+  int parent = lifts.parents[body];
+  if (parent < 0 || (size_t)parent >= body) {
+    return;
+  }
+  const double *parentPhysical = &lifts.physical[3 * parent];
+  const double *parentShift = &lifts.shifts[3 * parent];
+  double dx = x - parentPhysical[0], dy = y - parentPhysical[1],
+         dz = z - parentPhysical[2];
+  double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+  double factor = distance > 0 ? lifts.lifts[body] / distance : 0;
+  shift[0] = parentShift[0] + dx * factor;
+  shift[1] = parentShift[1] + dy * factor;
+  shift[2] = parentShift[2] + dz * factor;
+  x += shift[0];
+  y += shift[1];
+  z += shift[2];
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef FRAME_WRITER_HPP
+#define FRAME_WRITER_HPP
+
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Formats frames can be written in
+enum CaptureFormat {
+  CAPTURE_PPM, // one binary PPM file per frame, named from a printf pattern
+  CAPTURE_RAW  // all frames as a single raw RGB stream (a file or stdout)
+};
+
+// Define a structure for writing frames to disk on a background thread. The
+// frame buffers are allocated once, and the renderer fills a free one while
+// the writer thread saves the filled ones
+struct FrameWriter {
+  int width = 0, height = 0;
+  CaptureFormat format = CAPTURE_PPM;
+  std::string output;
+  FILE *stream = nullptr; // for the raw format
+  std::vector<std::vector<unsigned char>> slots;
+  std::vector<long> slotFrame; // frame index held by each slot
+
+  // Fixed-capacity queues of slot indices
+  std::vector<int> freeSlots, filledSlots;
+  size_t filledHead = 0, filledCount = 0;
+  int pendingSlot = -1; // slot handed to the renderer
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+  bool stopping = false;
+  bool failed = false;
+  char path[4096];
+};
+
+// Function to save one frame. OpenGL returns the rows from the bottom up, so
+// they are written in reverse order
+bool writeFrame(FrameWriter &writer, const unsigned char *pixels,
+                long frame) {
+  size_t rowBytes = (size_t)writer.width * 3;
+  FILE *file = writer.stream;
+
+  if (writer.format == CAPTURE_PPM) {
+    snprintf(writer.path, sizeof(writer.path), writer.output.c_str(),
+             (int)frame);
+    file = fopen(writer.path, "wb");
+    if (file == nullptr) {
+      std::cerr << "Could not create frame file '" << writer.path << "'."
+                << std::endl;
+      return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", writer.width, writer.height);
+  }
+
+  bool written = true;
+  for (int row = writer.height - 1; row >= 0 && written; row--) {
+    written = fwrite(pixels + row * rowBytes, 1, rowBytes, file) == rowBytes;
+  }
+
+  if (writer.format == CAPTURE_PPM) {
+    written = fclose(file) == 0 && written;
+  }
+  if (!written) {
+    std::cerr << "Could not write frame " << frame << "." << std::endl;
+  }
+  return written;
+}
+
+// Main loop of the writer thread
+void frameWriterLoop(FrameWriter &writer) {
+  std::unique_lock<std::mutex> lock(writer.mutex);
+
+  while (true) {
+    writer.changed.wait(
+        lock, [&] { return writer.filledCount > 0 || writer.stopping; });
+    if (writer.filledCount == 0) {
+      return;
+    }
+
+    int slot = writer.filledSlots[writer.filledHead];
+    lock.unlock();
+    bool written = writeFrame(writer, writer.slots[slot].data(),
+                              writer.slotFrame[slot]);
+    lock.lock();
+
+    writer.failed = writer.failed || !written;
+    writer.filledHead = (writer.filledHead + 1) % writer.filledSlots.size();
+    writer.filledCount--;
+    writer.freeSlots.push_back(slot);
+    writer.changed.notify_all();
+  }
+}
+
+// Function to tell whether a PPM output is a printf pattern with exactly one
+// integer conversion, such as %05d, and no other conversion than %%. Anything
+// else would make printf read arguments it is not given
+bool validFramePattern(const std::string &pattern) {
+  int conversions = 0;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if (pattern[i] != '%') {
+      continue;
+    }
+    if (++i < pattern.size() && pattern[i] == '%') {
+      continue;
+    }
+    while (i < pattern.size() && strchr("-+ 0#", pattern[i]) != nullptr) {
+      i++;
+    }
+    while (i < pattern.size() && isdigit((unsigned char)pattern[i])) {
+      i++;
+    }
+    if (i < pattern.size() && pattern[i] == '.') {
+      i++;
+      while (i < pattern.size() && isdigit((unsigned char)pattern[i])) {
+        i++;
+      }
+    }
+    if (i >= pattern.size() || (pattern[i] != 'd' && pattern[i] != 'i')) {
+      return false;
+    }
+    conversions++;
+  }
+  return conversions == 1;
+}
+
+// Function to start writing frames. An output of "-" streams raw RGB to the
+// standard output, a name ending in ".rgb" or ".raw" streams raw RGB to that
+// file, and anything else is a printf pattern for the PPM file of each frame
+bool startFrameWriter(FrameWriter &writer, int width, int height,
+                      const std::string &output, int slotCount) {
+  writer.width = width;
+  writer.height = height;
+  writer.output = output;
+
+  auto endsWith = [&](const char *suffix) {
+    size_t length = strlen(suffix);
+    return output.size() >= length &&
+           output.compare(output.size() - length, length, suffix) == 0;
+  };
+  if (output == "-") {
+    writer.format = CAPTURE_RAW;
+    writer.stream = stdout;
+  } else if (endsWith(".rgb") || endsWith(".raw")) {
+    writer.format = CAPTURE_RAW;
+    writer.stream = fopen(output.c_str(), "wb");
+    if (writer.stream == nullptr) {
+      std::cerr << "Could not create '" << output << "'." << std::endl;
+      return false;
+    }
+  } else if (validFramePattern(output)) {
+    writer.format = CAPTURE_PPM;
+  } else {
+    std::cerr << "The frame output '" << output
+              << "' needs a single frame number pattern such as frame%05d.ppm."
+              << std::endl;
+    return false;
+  }
+
+  writer.slots.assign(slotCount,
+                      std::vector<unsigned char>((size_t)width * height * 3));
+  writer.slotFrame.assign(slotCount, 0);
+  writer.filledSlots.assign(slotCount, 0);
+  writer.freeSlots.clear();
+  writer.freeSlots.reserve(slotCount);
+  for (int slot = 0; slot < slotCount; slot++) {
+    writer.freeSlots.push_back(slot);
+  }
+
+  writer.thread = std::thread(frameWriterLoop, std::ref(writer));
+  return true;
+}
+
+// Function to get a free frame buffer to fill, waiting for the writer thread
+// if all of them are queued
+unsigned char *acquireFrame(FrameWriter &writer) {
+  std::unique_lock<std::mutex> lock(writer.mutex);
+  writer.changed.wait(lock, [&] { return !writer.freeSlots.empty(); });
+  writer.pendingSlot = writer.freeSlots.back();
+  writer.freeSlots.pop_back();
+  return writer.slots[writer.pendingSlot].data();
+}
+
+// Function to queue the frame buffer taken by acquireFrame for writing
+void submitFrame(FrameWriter &writer, long frame) {
+  std::lock_guard<std::mutex> lock(writer.mutex);
+  size_t tail =
+      (writer.filledHead + writer.filledCount) % writer.filledSlots.size();
+  writer.slotFrame[writer.pendingSlot] = frame;
+  writer.filledSlots[tail] = writer.pendingSlot;
+  writer.filledCount++;
+  writer.pendingSlot = -1;
+  writer.changed.notify_all();
+}
+
+// Function to write the queued frames and stop the writer thread. Returns
+// false if any frame could not be written
+bool stopFrameWriter(FrameWriter &writer) {
+  {
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.stopping = true;
+  }
+  writer.changed.notify_all();
+  if (writer.thread.joinable()) {
+    writer.thread.join();
+  }
+
+  if (writer.stream != nullptr) {
+    writer.failed = fflush(writer.stream) != 0 || writer.failed;
+    if (writer.stream != stdout) {
+      fclose(writer.stream);
+    }
+    writer.stream = nullptr;
+  }
+  return !writer.failed;
+}
+
+#endif
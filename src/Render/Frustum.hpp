@@ -0,0 +1,112 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include "../Structs/Coordinates.hpp"
+#include <cmath>
+
+// Define a plane as a x + b y + c z + d = 0, with (a, b, c) a unit normal
+// pointing to the inside of the frustum
+struct Plane {
+  double a, b, c, d;
+};
+
+// Define a structure for the six planes bounding the visible volume
+struct Frustum {
+  Plane planes[6];
+};
+
+// Define a structure counting the objects drawn and culled in a frame
+struct CullingStats {
+  unsigned int drawn = 0;
+  unsigned int culled = 0;
+};
+
+// Function to build a plane from a normal (not necessarily unit) and a point
+Plane makePlane(double nx, double ny, double nz, double px, double py,
+                double pz) {
+  double length = sqrt(nx * nx + ny * ny + nz * nz);
+  nx /= length;
+  ny /= length;
+  nz /= length;
+  return {nx, ny, nz, -(nx * px + ny * py + nz * pz)};
+}
+
+// Function to build the frustum of a camera placed like gluLookAt (with the y
+// axis up) and projected like gluPerspective
+void buildFrustum(Frustum &frustum, Coordinates eye, Coordinates target,
+                  double fov, double aspect, double near, double far) {
+  // Camera basis: forward, right and up
+  double fx = target.x - eye.x, fy = target.y - eye.y, fz = target.z - eye.z;
+  double length = sqrt(fx * fx + fy * fy + fz * fz);
+  fx /= length;
+  fy /= length;
+  fz /= length;
+  double rx = -fz, rz = fx; // forward x (0, 1, 0)
+  length = sqrt(rx * rx + rz * rz);
+  rx /= length;
+  rz /= length;
+  double ux = -rz * fy, uy = rz * fx - rx * fz, uz = rx * fy;
+
+  double tanV = tan(fov * M_PI / 360), tanH = tanV * aspect;
+
+  frustum.planes[0] = makePlane(fx, fy, fz, eye.x + fx * near,
+                                eye.y + fy * near, eye.z + fz * near);
+  frustum.planes[1] = makePlane(-fx, -fy, -fz, eye.x + fx * far,
+                                eye.y + fy * far, eye.z + fz * far);
+  // Sides, all through the eye
+  frustum.planes[2] = makePlane(rx + tanH * fx, tanH * fy, rz + tanH * fz,
+                                eye.x, eye.y, eye.z);
+  frustum.planes[3] = makePlane(-rx + tanH * fx, tanH * fy, -rz + tanH * fz,
+                                eye.x, eye.y, eye.z);
+  frustum.planes[4] = makePlane(ux + tanV * fx, uy + tanV * fy,
+                                uz + tanV * fz, eye.x, eye.y, eye.z);
+  frustum.planes[5] = makePlane(-ux + tanV * fx, -uy + tanV * fy,
+                                -uz + tanV * fz, eye.x, eye.y, eye.z);
+}
+
+// Function to get the signed distance from a plane to a point
+double planeDistance(const Plane &plane, double x, double y, double z) {
+  return plane.a * x + plane.b * y + plane.c * z + plane.d;
+}
+
+// Function to check if a sphere may be visible
+bool sphereVisible(const Frustum &frustum, double x, double y, double z,
+                   double radius) {
+  for (const Plane &plane : frustum.planes) {
+    if (planeDistance(plane, x, y, z) < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to check if a segment may be visible. It is culled only when both
+// ends are outside the same plane
+bool segmentVisible(const Frustum &frustum, Coordinates start,
+                    Coordinates end) {
+  for (const Plane &plane : frustum.planes) {
+    if (planeDistance(plane, start.x, start.y, start.z) < 0 &&
+        planeDistance(plane, end.x, end.y, end.z) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to check a sphere and count it as drawn or culled
+bool cullSphere(const Frustum &frustum, CullingStats &stats, double x,
+                double y, double z, double radius) {
+  bool visible = sphereVisible(frustum, x, y, z, radius);
+  visible ? stats.drawn++ : stats.culled++;
+  return visible;
+}
+
+// Function to check a segment and count it as drawn or culled
+bool cullSegment(const Frustum &frustum, CullingStats &stats,
+                 Coordinates start, Coordinates end) {
+  bool visible = segmentVisible(frustum, start, end);
+  visible ? stats.drawn++ : stats.culled++;
+  return visible;
+}
+
+#endif
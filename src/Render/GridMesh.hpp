@@ -0,0 +1,108 @@
+#ifndef GRID_MESH_HPP
+#define GRID_MESH_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Structs/Coordinates.hpp"
+#include <GL/glut.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Number of grid cells per block. The grid is rebuilt only when the camera
+// crosses to another block, or the spacing or the visible radius change
+const int gridCellsPerBlock = 16;
+
+// Define a structure for the part of the X-Z grid around the camera, cached
+// in a vertex buffer
+struct GridMesh {
+  GLuint buffer = 0;
+  GLsizei vertexCount = 0;
+  std::vector<GLfloat> vertices;
+  // Parameters of the cached grid, 0 when nothing was built yet
+  int spacing = 0;
+  long blockX = 0, blockZ = 0;
+  long radius = 0;
+};
+
+// Function to rebuild the grid lines within the given radius of a block
+void buildGridMesh(GridMesh &grid, long centerX, long centerZ, long radius,
+                   int gridSize) {
+  // Lines stay aligned with the full grid, which starts at -gridSize
+  long spacing = grid.spacing;
+  auto snap = [&](long value) {
+    return (value + gridSize) / spacing * spacing - gridSize;
+  };
+  long minX = snap(std::max<long>(centerX - radius, -gridSize));
+  long maxX = std::min<long>(centerX + radius, gridSize);
+  long minZ = snap(std::max<long>(centerZ - radius, -gridSize));
+  long maxZ = std::min<long>(centerZ + radius, gridSize);
+
+  grid.vertices.clear();
+  for (long x = minX; x <= maxX; x += spacing) {
+    grid.vertices.insert(grid.vertices.end(),
+                         {GLfloat(x), 0, GLfloat(minZ), GLfloat(x), 0,
+                          GLfloat(maxZ)});
+  }
+  for (long z = minZ; z <= maxZ; z += spacing) {
+    grid.vertices.insert(grid.vertices.end(),
+                         {GLfloat(minX), 0, GLfloat(z), GLfloat(maxX), 0,
+                          GLfloat(z)});
+  }
+  grid.vertexCount = grid.vertices.size() / 3;
+
+  if (grid.buffer == 0) {
+    glGenBuffers(1, &grid.buffer);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, grid.buffer);
+  glBufferData(GL_ARRAY_BUFFER, grid.vertices.size() * sizeof(GLfloat),
+               grid.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Function to keep the cached grid covering what the camera can see: the
+// lines closer than the render distance, clipped to the full grid size
+void updateGridMesh(GridMesh &grid, Coordinates camera, int spacing,
+                    int renderDistance, int gridSize) {
+  double height = fabs(camera.y);
+  if (height >= renderDistance || spacing <= 0) {
+    grid.vertexCount = 0;
+    grid.radius = 0;
+    return;
+  }
+
+  long block = (long)spacing * gridCellsPerBlock;
+  long blockX = lround(floor(camera.x / block));
+  long blockZ = lround(floor(camera.z / block));
+  double visible = sqrt((double)renderDistance * renderDistance -
+                        height * height);
+  // One extra block covers the camera moving inside its block
+  long radius = ((long)ceil(visible / block) + 1) * block;
+
+  if (spacing != grid.spacing || blockX != grid.blockX ||
+      blockZ != grid.blockZ || radius != grid.radius) {
+    grid.spacing = spacing;
+    grid.blockX = blockX;
+    grid.blockZ = blockZ;
+    grid.radius = radius;
+    buildGridMesh(grid, blockX * block + block / 2, blockZ * block + block / 2,
+                  radius, gridSize);
+  }
+}
+
+// Function to draw the cached grid lines
+void drawGridMesh(const GridMesh &grid) {
+  if (grid.vertexCount == 0) {
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, grid.buffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, 0);
+  glDrawArrays(GL_LINES, 0, grid.vertexCount);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef OFFSCREEN_CONTEXT_HPP
+#define OFFSCREEN_CONTEXT_HPP
+
+#include <iostream>
+#include <type_traits>
+
+// EGL is loaded when an offscreen context is first created, so the windowed
+// simulation neither links nor needs it. Without its headers, the program is
+// built without offscreen rendering
+#if __has_include(<EGL/egl.h>)
+#define OFFSCREEN_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>
+#endif
+
+#if defined(OFFSCREEN_EGL)
+// Define the EGL functions used, resolved from the library at run time
+struct EglFunctions {
+  bool loaded = false;
+  PFNEGLGETPROCADDRESSPROC getProcAddress;
+  PFNEGLGETDISPLAYPROC getDisplay;
+  PFNEGLINITIALIZEPROC initialize;
+  PFNEGLBINDAPIPROC bindApi;
+  PFNEGLCHOOSECONFIGPROC chooseConfig;
+  PFNEGLCREATEPBUFFERSURFACEPROC createPbufferSurface;
+  PFNEGLCREATECONTEXTPROC createContext;
+  PFNEGLMAKECURRENTPROC makeCurrent;
+  PFNEGLGETERRORPROC getError;
+  PFNEGLDESTROYCONTEXTPROC destroyContext;
+  PFNEGLDESTROYSURFACEPROC destroySurface;
+  PFNEGLTERMINATEPROC terminate;
+};
+
+EglFunctions egl;
+
+// Function to load the EGL library and its functions, once. Returns false if
+// the library or one of the functions is missing
+bool loadEgl() {
+  if (egl.loaded) {
+    return true;
+  }
+  void *library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_GLOBAL);
+  if (library == nullptr) {
+    std::cerr << "Could not load libEGL.so.1, which offscreen rendering needs."
+              << std::endl;
+    return false;
+  }
+
+  bool found = true;
+  auto resolve = [&](auto &function, const char *name) {
+    function = (std::remove_reference_t<decltype(function)>)dlsym(library,
+                                                                   name);
+    found = found && function != nullptr;
+  };
+  resolve(egl.getProcAddress, "eglGetProcAddress");
+  resolve(egl.getDisplay, "eglGetDisplay");
+  resolve(egl.initialize, "eglInitialize");
+  resolve(egl.bindApi, "eglBindAPI");
+  resolve(egl.chooseConfig, "eglChooseConfig");
+  resolve(egl.createPbufferSurface, "eglCreatePbufferSurface");
+  resolve(egl.createContext, "eglCreateContext");
+  resolve(egl.makeCurrent, "eglMakeCurrent");
+  resolve(egl.getError, "eglGetError");
+  resolve(egl.destroyContext, "eglDestroyContext");
+  resolve(egl.destroySurface, "eglDestroySurface");
+  resolve(egl.terminate, "eglTerminate");
+  if (!found) {
+    std::cerr << "The EGL library lacks functions offscreen rendering needs."
+              << std::endl;
+    return false;
+  }
+  egl.loaded = true;
+  return true;
+}
+
+// Define a structure for an OpenGL context without any window, rendering to
+// a pbuffer in memory
+struct OffscreenContext {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLContext context = EGL_NO_CONTEXT;
+};
+
+// Function to get an EGL display that needs neither a GPU nor a display
+// server, falling back to the default display
+EGLDisplay offscreenDisplay() {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)egl.getProcAddress(
+          "eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay != nullptr) {
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                            EGL_DEFAULT_DISPLAY, nullptr);
+    if (display != EGL_NO_DISPLAY) {
+      return display;
+    }
+  }
+  return egl.getDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// Function to create an offscreen context with a compatibility profile (the
+// simulation uses the fixed-function pipeline) and make it current
+bool createOffscreenContext(OffscreenContext &offscreen, int width,
+                            int height) {
+  if (!loadEgl()) {
+    return false;
+  }
+  offscreen.display = offscreenDisplay();
+  if (offscreen.display == EGL_NO_DISPLAY ||
+      !egl.initialize(offscreen.display, nullptr, nullptr)) {
+    std::cerr << "Could not initialize an EGL display." << std::endl;
+    return false;
+  }
+
+  const EGLint configAttributes[] = {EGL_SURFACE_TYPE,
+                                     EGL_PBUFFER_BIT,
+                                     EGL_RENDERABLE_TYPE,
+                                     EGL_OPENGL_BIT,
+                                     EGL_RED_SIZE,
+                                     8,
+                                     EGL_GREEN_SIZE,
+                                     8,
+                                     EGL_BLUE_SIZE,
+                                     8,
+                                     EGL_DEPTH_SIZE,
+                                     24,
+                                     EGL_NONE};
+  EGLConfig config;
+  EGLint configCount = 0;
+  if (!egl.bindApi(EGL_OPENGL_API) ||
+      !egl.chooseConfig(offscreen.display, configAttributes, &config, 1,
+                       &configCount) ||
+      configCount == 0) {
+    std::cerr << "No EGL configuration supports offscreen OpenGL."
+              << std::endl;
+    return false;
+  }
+
+  const EGLint surfaceAttributes[] = {EGL_WIDTH, width, EGL_HEIGHT, height,
+                                      EGL_NONE};
+  offscreen.surface =
+      egl.createPbufferSurface(offscreen.display, config, surfaceAttributes);
+  offscreen.context = egl.createContext(offscreen.display, config,
+                                       EGL_NO_CONTEXT, nullptr);
+  if (offscreen.surface == EGL_NO_SURFACE ||
+      offscreen.context == EGL_NO_CONTEXT ||
+      !egl.makeCurrent(offscreen.display, offscreen.surface, offscreen.surface,
+                      offscreen.context)) {
+    std::cerr << "Could not create the offscreen OpenGL context (EGL error 0x"
+              << std::hex << egl.getError() << std::dec << ")." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// Function to release the offscreen context
+void destroyOffscreenContext(OffscreenContext &offscreen) {
+  if (offscreen.display == EGL_NO_DISPLAY) {
+    return;
+  }
+  egl.makeCurrent(offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  if (offscreen.context != EGL_NO_CONTEXT) {
+    egl.destroyContext(offscreen.display, offscreen.context);
+  }
+  if (offscreen.surface != EGL_NO_SURFACE) {
+    egl.destroySurface(offscreen.display, offscreen.surface);
+  }
+  egl.terminate(offscreen.display);
+  offscreen = OffscreenContext();
+}
+#else
+// Define a structure standing for an offscreen context, which this build
+// cannot create
+struct OffscreenContext {};
+
+// Function to report that offscreen rendering is not available
+bool createOffscreenContext(OffscreenContext &, int, int) {
+  std::cerr << "This build has no offscreen rendering: the EGL headers were "
+               "missing."
+            << std::endl;
+  return false;
+}
+
+// Function to release the offscreen context, which does nothing here
+void destroyOffscreenContext(OffscreenContext &) {}
+#endif
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef ORBIT_TRAILS_HPP
+#define ORBIT_TRAILS_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Simulation/SnapshotBuffer.hpp"
+#include "../Structs/Color.hpp"
+#include "DrawnLifts.hpp"
+#include <GL/glut.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Texels of the ramp that fades the trails from their newest to their oldest
+// sample
+const int trailFadeTexels = 64;
+// Sample numbers are stored as floats, so they are brought back to 0 before
+// they lose precision
+const GLfloat trailSampleLimit = 1 << 22;
+
+// Define the layout of a trail sample in the vertex buffer: its position, its
+// sample number, which fades it through a texture, and the color of its body
+struct TrailVertex {
+  GLfloat x, y, z;
+  GLfloat sample;
+  GLubyte color[4];
+};
+
+// Define a structure for the trails of the first bodies of a system. Every
+// trail is a ring of samples stored in a single vertex buffer, one trail
+// after the other, with one more vertex repeating the first slot of the
+// ring, so a full ring is drawn as two line strips. All the memory is
+// allocated when the trails are created. When bodies are removed, a trail
+// whose body is gone starts again from the body moved to its index, and the
+// trails past the last body are hidden. Their colors stay right, since the
+// bodies drawn one by one come first and are never moved
+struct OrbitTrails {
+  GLuint buffer = 0;
+  GLuint fade = 0;
+  size_t count = 0;        // bodies with a trail
+  size_t live = 0;         // trails drawn, one per body left
+  std::vector<uint32_t> ids; // body of each trail, when the snapshots say
+  GLsizei capacity = 0;    // samples per trail
+  unsigned int decimation = 1;
+  unsigned long lastStep = 0; // publication of the last sample / decimation
+  GLsizei head = 0;        // slot of the next sample
+  GLsizei filled = 0;      // samples in each ring
+  GLfloat nextSample = 0;  // number of the next sample
+  std::vector<TrailVertex> vertices;
+  std::vector<GLint> firsts; // line strips of the last draw
+  std::vector<GLsizei> counts;
+};
+
+// Function to create the trails of the given number of bodies, keeping a
+// sample every decimation publications of the physics thread
+void createOrbitTrails(OrbitTrails &trails, const std::vector<Color> &colors,
+                       GLsizei capacity, unsigned int decimation) {
+  trails.count = colors.size();
+  trails.live = trails.count;
+  trails.ids.clear();
+  trails.capacity = std::max<GLsizei>(capacity, 2);
+  trails.decimation = std::max(decimation, 1u);
+  trails.lastStep = 0;
+  trails.head = 0;
+  trails.filled = 0;
+  trails.nextSample = 0;
+
+  size_t ring = trails.capacity + 1;
+  trails.vertices.assign(trails.count * ring, TrailVertex());
+  for (size_t body = 0; body < trails.count; body++) {
+    GLubyte color[4] = {GLubyte(colors[body].r * 255),
+                        GLubyte(colors[body].g * 255),
+                        GLubyte(colors[body].b * 255), 255};
+    for (size_t slot = 0; slot < ring; slot++) {
+      std::copy(color, color + 4, trails.vertices[body * ring + slot].color);
+    }
+  }
+  trails.firsts.assign(2 * trails.count, 0);
+  trails.counts.assign(2 * trails.count, 0);
+
+  if (trails.buffer == 0) {
+    glGenBuffers(1, &trails.buffer);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, trails.buffer);
+  glBufferData(GL_ARRAY_BUFFER, trails.vertices.size() * sizeof(TrailVertex),
+               trails.vertices.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  GLubyte ramp[trailFadeTexels][2];
+  for (int i = 0; i < trailFadeTexels; i++) {
+    ramp[i][0] = 255;
+    ramp[i][1] = i * 255 / (trailFadeTexels - 1);
+  }
+  if (trails.fade == 0) {
+    glGenTextures(1, &trails.fade);
+  }
+  glBindTexture(GL_TEXTURE_1D, trails.fade);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_LUMINANCE_ALPHA, trailFadeTexels, 0,
+               GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, ramp);
+  glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+// Function to start a trail again from the given position, filling its ring
+// with it so the trail grows from nothing
+void restartTrail(OrbitTrails &trails, size_t body, GLfloat x, GLfloat y,
+                  GLfloat z) {
+  size_t ring = trails.capacity + 1;
+  for (size_t slot = 0; slot < ring; slot++) {
+    TrailVertex &vertex = trails.vertices[body * ring + slot];
+    vertex.x = x;
+    vertex.y = y;
+    vertex.z = z;
+  }
+}
+
+// Function to add the positions of a snapshot to the trails, if enough
+// publications went by since the last sample. Only the new slot of each
+// ring is written to the vertex buffer, unless a trail changed body. The
+// samples are placed where their bodies are drawn
+void pushTrailSample(OrbitTrails &trails, const Snapshot &snapshot,
+                     double scale, DrawnLifts &lifts) {
+  unsigned long step = snapshot.sequence / trails.decimation;
+  if (trails.count == 0 || step == trails.lastStep) {
+    return;
+  }
+  trails.lastStep = step;
+  trails.live = std::min(trails.count, snapshot.x.size());
+
+  // Bodies only move to lower indices, from the end of the system, so a
+  // trail whose id changed has lost its body for good
+  bool restarted = false;
+  if (trails.ids.empty()) {
+    trails.ids.assign(snapshot.ids.begin(),
+                      snapshot.ids.begin() +
+                          std::min(trails.count, snapshot.ids.size()));
+  }
+  for (size_t body = 0; body < std::min(trails.live, snapshot.ids.size());
+       body++) {
+    if (trails.ids[body] != snapshot.ids[body]) {
+      trails.ids[body] = snapshot.ids[body];
+      restartTrail(trails, body, snapshot.x[body] * scale,
+                   snapshot.y[body] * scale, snapshot.z[body] * scale);
+      restarted = true;
+    }
+  }
+
+  size_t ring = trails.capacity + 1;
+  bool rebase = trails.nextSample >= trailSampleLimit;
+  if (rebase) {
+    GLfloat offset = trails.nextSample - trails.capacity;
+    for (TrailVertex &vertex : trails.vertices) {
+      vertex.sample -= offset;
+    }
+    trails.nextSample -= offset;
+  }
+
+  for (size_t body = 0; body < trails.live; body++) {
+    TrailVertex &vertex = trails.vertices[body * ring + trails.head];
+    double x = snapshot.x[body] * scale, y = snapshot.y[body] * scale,
+           z = snapshot.z[body] * scale;
+    liftPosition(lifts, body, x, y, z);
+    vertex.x = x;
+    vertex.y = y;
+    vertex.z = z;
+    vertex.sample = trails.nextSample;
+    if (trails.head == 0) {
+      trails.vertices[body * ring + trails.capacity] = vertex;
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, trails.buffer);
+  if (rebase || restarted) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0,
+                    trails.vertices.size() * sizeof(TrailVertex),
+                    trails.vertices.data());
+  } else {
+    // A slot replaced while the previous frame is still drawn only moves the
+    // end of a trail by one sample, so there is no need to wait for it
+    TrailVertex *mapped = (TrailVertex *)glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, trails.vertices.size() * sizeof(TrailVertex),
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped != nullptr) {
+      for (size_t body = 0; body < trails.live; body++) {
+        size_t slot = body * ring + trails.head;
+        mapped[slot] = trails.vertices[slot];
+        if (trails.head == 0) {
+          mapped[slot + trails.capacity] = trails.vertices[slot];
+        }
+      }
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  trails.head = (trails.head + 1) % trails.capacity;
+  trails.filled = std::min(trails.filled + 1, trails.capacity);
+  trails.nextSample++;
+}
+
+// Function to draw every trail in a single call, fading them from their
+// newest sample to their oldest one
+void drawOrbitTrails(OrbitTrails &trails) {
+  if (trails.filled < 2) {
+    return;
+  }
+
+  // The oldest samples are at the head of full rings, which are drawn in
+  // two pieces: from the head to the repeated first slot, then from the
+  // first slot to the newest sample
+  GLsizei ring = trails.capacity + 1;
+  bool wrapped = trails.filled == trails.capacity && trails.head > 0;
+  GLsizei strips = 0;
+  for (size_t body = 0; body < trails.live; body++) {
+    GLint start = body * ring;
+    if (wrapped) {
+      trails.firsts[strips] = start + trails.head;
+      trails.counts[strips++] = trails.capacity - trails.head + 1;
+      if (trails.head > 1) {
+        trails.firsts[strips] = start;
+        trails.counts[strips++] = trails.head;
+      }
+    } else {
+      trails.firsts[strips] = start;
+      trails.counts[strips++] = trails.filled;
+    }
+  }
+
+  // The texture coordinate of a sample is its age, as a fraction of the
+  // ring, from 0 for the oldest one to almost 1 for the newest one
+  glMatrixMode(GL_TEXTURE);
+  glLoadIdentity();
+  glScalef(1.0f / trails.capacity, 1, 1);
+  glTranslatef(trails.capacity - trails.nextSample, 0, 0);
+  glMatrixMode(GL_MODELVIEW);
+
+  glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+  glEnable(GL_TEXTURE_1D);
+  glBindTexture(GL_TEXTURE_1D, trails.fade);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glBindBuffer(GL_ARRAY_BUFFER, trails.buffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(TrailVertex),
+                  (const GLvoid *)offsetof(TrailVertex, x));
+  glTexCoordPointer(1, GL_FLOAT, sizeof(TrailVertex),
+                    (const GLvoid *)offsetof(TrailVertex, sample));
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TrailVertex),
+                 (const GLvoid *)offsetof(TrailVertex, color));
+  glMultiDrawArrays(GL_LINE_STRIP, trails.firsts.data(), trails.counts.data(),
+                    strips);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glBindTexture(GL_TEXTURE_1D, 0);
+  glPopAttrib();
+  glMatrixMode(GL_TEXTURE);
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+#endif
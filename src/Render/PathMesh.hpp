@@ -0,0 +1,56 @@
+#ifndef PATH_MESH_HPP
+#define PATH_MESH_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Simulation/SplinePath.hpp"
+#include <GL/glut.h>
+#include <vector>
+
+// Define a structure for the line of a path and the line of its control
+// points, stored one after the other in a vertex buffer
+struct PathMesh {
+  GLuint buffer = 0;
+  GLsizei curveCount = 0, controlCount = 0;
+};
+
+// Function to upload the lines of a path. Paths do not change, so this is
+// done once and each line is drawn with a single call afterwards
+void uploadPathMesh(PathMesh &mesh, const SplinePath &path) {
+  std::vector<Coordinates> vertices = path.table;
+  vertices.insert(vertices.end(), path.control.begin(), path.control.end());
+  mesh.curveCount = path.table.size();
+  mesh.controlCount = path.control.size();
+
+  if (mesh.buffer == 0) {
+    glGenBuffers(1, &mesh.buffer);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Coordinates),
+               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Function to draw the vertices [first, first + count) of a path mesh as a
+// line
+void drawPathLine(const PathMesh &mesh, GLint first, GLsizei count) {
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(Coordinates), 0);
+  glDrawArrays(GL_LINE_STRIP, first, count);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Function to draw the curve of a path
+void drawPathCurve(const PathMesh &mesh) {
+  drawPathLine(mesh, 0, mesh.curveCount);
+}
+
+// Function to draw the line between the control points of a path
+void drawPathControl(const PathMesh &mesh) {
+  drawPathLine(mesh, mesh.curveCount, mesh.controlCount);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef PIXEL_READBACK_HPP
+#define PIXEL_READBACK_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <cstring>
+
+// Define a structure for reading rendered frames back through two pixel
+// buffers. The copy of a frame is started in one buffer and only collected
+// after the next frame is drawn, so the driver can finish it in the meantime
+struct PixelReadback {
+  GLuint buffers[2] = {0, 0};
+  int width = 0, height = 0;
+  int oldest = 0;  // buffer holding the oldest frame not yet collected
+  int pending = 0; // frames started and not yet collected
+};
+
+// Function to create the pixel buffers for frames of the given size
+void createPixelReadback(PixelReadback &readback, int width, int height) {
+  readback.width = width;
+  readback.height = height;
+  glGenBuffers(2, readback.buffers);
+  for (GLuint buffer : readback.buffers) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 3, nullptr,
+                 GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Function to start copying the rendered frame into a free pixel buffer. At
+// most two frames can be pending
+void startReadback(PixelReadback &readback) {
+  GLuint buffer = readback.buffers[(readback.oldest + readback.pending) % 2];
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+  glReadPixels(0, 0, readback.width, readback.height, GL_RGB,
+               GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.pending++;
+}
+
+// Function to copy the oldest pending frame, with its rows from the bottom
+// up, into the given memory
+bool collectReadback(PixelReadback &readback, unsigned char *pixels) {
+  if (readback.pending == 0) {
+    return false;
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[readback.oldest]);
+  const void *mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (mapped != nullptr) {
+    memcpy(pixels, mapped, (size_t)readback.width * readback.height * 3);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback.oldest ^= 1;
+  readback.pending--;
+  return mapped != nullptr;
+}
+
+// Function to release the pixel buffers
+void destroyPixelReadback(PixelReadback &readback) {
+  glDeleteBuffers(2, readback.buffers);
+  readback = PixelReadback();
+}
+
+#endif
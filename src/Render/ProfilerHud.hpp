@@ -0,0 +1,87 @@
+#ifndef PROFILER_HUD_HPP
+#define PROFILER_HUD_HPP
+
+#include "../Profiling/Profiler.hpp"
+#include <GL/glut.h>
+#include <cstdio>
+
+// Latest samples of each section summarized by the overlay
+const uint64_t profileHudWindow = 256;
+
+// Function to write a line of text at a position of the window, in pixels
+// from its top left corner
+void drawHudText(int x, int y, const char *text) {
+  glRasterPos2i(x, y);
+  for (const char *c = text; *c != '\0'; c++) {
+    glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+  }
+}
+
+// Function to draw the percentiles of every timed section and counter over
+// the scene. The matrices and the state changed are restored, so it can be
+// called at the end of any frame
+void drawProfilerHud(Profiler &profiler, int width, int height) {
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, width, height, 0, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+
+  const int lineHeight = 15;
+  int y = 20;
+  char line[96];
+  glColor3f(1, 1, 0);
+  snprintf(line, sizeof(line), "%-13s %8s %8s %8s %8s", "section (ms)", "p50",
+           "p95", "p99", "max");
+  drawHudText(10, y, line);
+
+  glColor3f(1, 1, 1);
+  for (int section = 0; section < PROFILE_SECTION_COUNT; section++) {
+    ProfileStats stats =
+        profileStats(profiler, ProfileSection(section), profileHudWindow);
+    if (stats.samples == 0) {
+      continue;
+    }
+    y += lineHeight;
+    snprintf(line, sizeof(line), "%-13s %8.3f %8.3f %8.3f %8.3f",
+             profileSectionNames[section], stats.p50, stats.p95, stats.p99,
+             stats.max);
+    drawHudText(10, y, line);
+  }
+
+  // The counters follow under their own header
+  bool header = false;
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+    ProfileStats stats =
+        counterStats(profiler, ProfileCounter(counter), profileHudWindow);
+    if (stats.samples == 0) {
+      continue;
+    }
+    if (!header) {
+      y += lineHeight;
+      glColor3f(1, 1, 0);
+      snprintf(line, sizeof(line), "%-13s", "objects");
+      drawHudText(10, y, line);
+      glColor3f(1, 1, 1);
+      header = true;
+    }
+    y += lineHeight;
+    snprintf(line, sizeof(line), "%-13s %8.0f %8.0f %8.0f %8.0f",
+             profileCounterNames[counter], stats.p50, stats.p95, stats.p99,
+             stats.max);
+    drawHudText(10, y, line);
+  }
+
+  glPopAttrib();
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef RING_BATCH_HPP
+#define RING_BATCH_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Physics/RingParticles.hpp"
+#include "../Structs/Color.hpp"
+#include <GL/glut.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Side of the sprite texture drawn for every particle, in texels
+const int ringSpriteSize = 16;
+// Size of a particle at ringSpriteDistance from the camera, in pixels, and
+// the largest one when it is closer. Further particles shrink down to a
+// pixel, then fade out instead
+const GLfloat ringPointSize = 2;
+const GLfloat ringPointMaxSize = 8;
+const GLfloat ringSpriteDistance = 1000;
+const GLfloat ringAlpha = 0.6;
+// Particles smaller than this, in pixels, look the same as plain points,
+// which are much cheaper to rasterize than textured sprites
+const GLfloat ringSpriteMinSize = 2;
+
+// Define a structure for drawing the particles of a ring as point sprites in
+// a single call. The fixed-point positions are uploaded as they are, and the
+// buffer object keeps its capacity between frames
+struct RingBatch {
+  GLuint buffer = 0;
+  size_t bufferCapacity = 0; // in particles
+  GLuint sprite = 0;         // round texture shared by every particle
+};
+
+// Function to create the texture of a particle, a disc fading out toward its
+// edge
+void createRingSprite(RingBatch &batch) {
+  GLubyte texels[ringSpriteSize * ringSpriteSize * 2];
+  for (int row = 0; row < ringSpriteSize; row++) {
+    for (int column = 0; column < ringSpriteSize; column++) {
+      GLfloat u = (column + 0.5f) / ringSpriteSize * 2 - 1;
+      GLfloat v = (row + 0.5f) / ringSpriteSize * 2 - 1;
+      GLfloat fade = std::max(0.0f, 1 - (u * u + v * v));
+      GLubyte *texel = &texels[(row * ringSpriteSize + column) * 2];
+      texel[0] = 255;
+      texel[1] = 255 * fade * fade;
+    }
+  }
+
+  glGenTextures(1, &batch.sprite);
+  glBindTexture(GL_TEXTURE_2D, batch.sprite);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, ringSpriteSize,
+               ringSpriteSize, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+               texels);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Function to get the size of the particles, in pixels, at a distance from
+// the camera in scene units
+GLfloat ringParticleSize(GLfloat distance) {
+  GLfloat size = ringPointSize * ringSpriteDistance / std::max(distance, 1.0f);
+  return std::min(size, ringPointMaxSize);
+}
+
+// Function to upload the positions of the particles of a ring, as published
+// with a snapshot, and draw them around its body, at the given position in
+// scene units. The positions are scaled from their
+// fixed-point units by the model view matrix, and the particles shrink with
+// their distance to the camera, as sprites or as plain points. They are
+// blended without writing depth, so the ring stays translucent whatever the
+// order of its particles
+void drawRingBatch(RingBatch &batch, const RingParticles &ring,
+                   const std::vector<int32_t> &positions, const Color &color,
+                   GLdouble x, GLdouble y, GLdouble z, GLdouble scale,
+                   bool sprites) {
+  if (ring.count == 0 || positions.size() != 3 * ring.count) {
+    return;
+  }
+  if (batch.buffer == 0) {
+    glGenBuffers(1, &batch.buffer);
+    createRingSprite(batch);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, batch.buffer);
+  size_t bytes = positions.size() * sizeof(int32_t);
+  if (ring.count > batch.bufferCapacity) {
+    glBufferData(GL_ARRAY_BUFFER, bytes, positions.data(), GL_STREAM_DRAW);
+    batch.bufferCapacity = ring.count;
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, positions.data());
+  }
+
+  glPushMatrix();
+  glTranslated(x, y, z);
+  GLdouble unit = ring.quantum * scale;
+  glScaled(unit, unit, unit);
+
+  const GLfloat attenuation[3] = {
+      0, 0, 1 / (ringSpriteDistance * ringSpriteDistance)};
+  const GLfloat noAttenuation[3] = {1, 0, 0};
+  glPointSize(ringPointSize);
+  glPointParameterfv(GL_POINT_DISTANCE_ATTENUATION, attenuation);
+  glPointParameterf(GL_POINT_SIZE_MAX, ringPointMaxSize);
+  glPointParameterf(GL_POINT_FADE_THRESHOLD_SIZE, 1);
+  if (sprites) {
+    glEnable(GL_POINT_SPRITE);
+    glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, batch.sprite);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  }
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(GL_FALSE);
+
+  glColor4f(color.r, color.g, color.b, ringAlpha);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_INT, 0, 0);
+  glDrawArrays(GL_POINTS, 0, ring.count);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  if (sprites) {
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_FALSE);
+    glDisable(GL_POINT_SPRITE);
+  }
+  glPointParameterfv(GL_POINT_DISTANCE_ATTENUATION, noAttenuation);
+  glPointSize(1);
+  glPopMatrix();
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
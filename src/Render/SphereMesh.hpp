@@ -0,0 +1,103 @@
+#ifndef SPHERE_MESH_HPP
+#define SPHERE_MESH_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/glut.h>
+#include <cmath>
+#include <vector>
+
+// Tessellations of the cached spheres, from the coarsest to the finest, and
+// the largest projected radius (in pixels) each one is used for
+const int sphereLevels = 4;
+const int sphereSlices[sphereLevels] = {8, 16, 32, 80};
+const int sphereStacks[sphereLevels] = {6, 10, 20, 40};
+const GLfloat sphereMaxPixels[sphereLevels - 1] = {4, 16, 64};
+
+// Define a structure holding unit spheres at several levels of detail in a
+// single vertex buffer and a single index buffer. As the spheres have unit
+// radius, each vertex is also its own normal
+struct SphereMesh {
+  GLuint vertexBuffer = 0, indexBuffer = 0;
+  GLsizei indexCount[sphereLevels];
+  size_t indexOffset[sphereLevels]; // in bytes, inside the index buffer
+  GLint baseVertex[sphereLevels];
+};
+
+// Function to build the unit sphere meshes and upload them to the GPU
+void buildSphereMesh(SphereMesh &mesh) {
+  std::vector<GLfloat> vertices;
+  std::vector<GLushort> indices;
+
+  for (int level = 0; level < sphereLevels; level++) {
+    int slices = sphereSlices[level], stacks = sphereStacks[level];
+    mesh.baseVertex[level] = vertices.size() / 3;
+    mesh.indexOffset[level] = indices.size() * sizeof(GLushort);
+
+    for (int stack = 0; stack <= stacks; stack++) {
+      double polar = M_PI * stack / stacks;
+      for (int slice = 0; slice <= slices; slice++) {
+        double azimuth = 2 * M_PI * slice / slices;
+        vertices.push_back(sin(polar) * cos(azimuth));
+        vertices.push_back(cos(polar));
+        vertices.push_back(-sin(polar) * sin(azimuth));
+      }
+    }
+
+    for (int stack = 0; stack < stacks; stack++) {
+      for (int slice = 0; slice < slices; slice++) {
+        GLushort first = stack * (slices + 1) + slice;
+        GLushort below = first + slices + 1;
+        indices.insert(indices.end(), {first, below, GLushort(first + 1)});
+        indices.insert(indices.end(),
+                       {GLushort(first + 1), below, GLushort(below + 1)});
+      }
+    }
+    mesh.indexCount[level] =
+        indices.size() - mesh.indexOffset[level] / sizeof(GLushort);
+  }
+
+  glGenBuffers(1, &mesh.vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glGenBuffers(1, &mesh.indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Function to pick the level of detail for a sphere covering the given
+// radius on the screen, in pixels
+int sphereLevelFor(GLfloat radiusPixels) {
+  int level = 0;
+  while (level < sphereLevels - 1 && radiusPixels > sphereMaxPixels[level]) {
+    level++;
+  }
+  return level;
+}
+
+// Function to draw a unit sphere of the given level of detail, scaled and
+// placed by the current modelview matrix
+void drawSphere(const SphereMesh &mesh, int level) {
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  const GLvoid *first =
+      (const GLvoid *)(mesh.baseVertex[level] * 3 * sizeof(GLfloat));
+  glVertexPointer(3, GL_FLOAT, 0, first);
+  glNormalPointer(GL_FLOAT, 0, first);
+  glDrawElements(GL_TRIANGLES, mesh.indexCount[level], GL_UNSIGNED_SHORT,
+                 (const GLvoid *)mesh.indexOffset[level]);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef STAR_CATALOGUE_HPP
+#define STAR_CATALOGUE_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "StarField.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Bytes of a star catalogue read and parsed at once
+const size_t catalogueBlockSize = 1 << 22;
+// Gray level of the faintest stars of a catalogue
+const GLfloat catalogueFaintestLevel = 0.1;
+
+// Define the columns of a star catalogue, by their index in its header
+struct CatalogueColumns {
+  int ra = -1, dec = -1; // in degrees
+  int magnitude = -1;
+  int color = -1; // color index, optional
+};
+
+// Function to hash the counter of a random draw into a uniform number in
+// [0, 1). A draw only depends on the seed and its counter, so the stars are
+// the same whatever the thread drawing them and the C library
+double starRandom(unsigned int seed, uint64_t counter) {
+  uint64_t z = ((uint64_t)seed << 32) + counter + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  return (z >> 11) * 0x1.0p-53;
+}
+
+// Function to generate a field of random stars, uniform over the sky, in
+// parallel. The same seed always yields the same stars
+void generateStars(std::vector<StarVertex> &stars, size_t count,
+                   unsigned int seed, ThreadPool &pool) {
+  stars.resize(count);
+  parallelFor(pool, 0, count, chunkSizeFor(pool, count, 4096),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  // A uniform height and a uniform angle around the vertical
+                  // give a uniform direction
+                  GLfloat y = 2 * starRandom(seed, 3 * i) - 1;
+                  GLfloat angle = 2 * M_PI * starRandom(seed, 3 * i + 1);
+                  GLfloat radius = sqrt(std::max(0.0f, 1 - y * y));
+                  GLubyte level =
+                      fabs(starRandom(seed, 3 * i + 2) - 0.3) * 255;
+                  stars[i] = {radius * cosf(angle),
+                              y,
+                              radius * sinf(angle),
+                              {level, level, level, 255}};
+                }
+              });
+}
+
+// Function to tint a star from its color index, from blue for the hottest
+// stars to orange for the coolest ones
+void starTint(GLfloat index, GLfloat tint[3]) {
+  const GLfloat keys[][4] = {{-0.4, 0.61, 0.71, 1.0},  {0.0, 0.85, 0.9, 1.0},
+                             {0.6, 1.0, 1.0, 0.95},   {1.2, 1.0, 0.85, 0.65},
+                             {2.0, 1.0, 0.65, 0.4}};
+  const int count = sizeof(keys) / sizeof(keys[0]);
+  int key = 1;
+  while (key < count - 1 && index > keys[key][0]) {
+    key++;
+  }
+  GLfloat t = (index - keys[key - 1][0]) / (keys[key][0] - keys[key - 1][0]);
+  t = std::max(0.0f, std::min(1.0f, t));
+  for (int c = 0; c < 3; c++) {
+    tint[c] = keys[key - 1][c + 1] +
+              t * (keys[key][c + 1] - keys[key - 1][c + 1]);
+  }
+}
+
+// Function to find the columns of a catalogue in its header, whose names are
+// matched without case, quotes or spaces
+bool readCatalogueHeader(char *line, CatalogueColumns &columns) {
+  const char *ra[] = {"ra", "raj2000", "ra_deg", "radeg"};
+  const char *dec[] = {"dec", "de", "dej2000", "dec_deg", "dedeg"};
+  const char *magnitude[] = {"mag", "vmag", "hpmag", "phot_g_mean_mag"};
+  const char *color[] = {"b_v", "b-v", "bv", "bp_rp"};
+  auto matches = [](const std::string &name, const char **names, int count) {
+    return std::find_if(names, names + count, [&](const char *candidate) {
+             return name == candidate;
+           }) != names + count;
+  };
+
+  int column = 0;
+  for (char *field = line; field != nullptr; column++) {
+    char *next = strchr(field, ',');
+    if (next != nullptr) {
+      *next++ = '\0';
+    }
+    std::string name;
+    for (char *c = field; *c != '\0'; c++) {
+      if (!isspace((unsigned char)*c) && *c != '"') {
+        name += tolower((unsigned char)*c);
+      }
+    }
+    if (matches(name, ra, 4)) {
+      columns.ra = column;
+    } else if (matches(name, dec, 5)) {
+      columns.dec = column;
+    } else if (matches(name, magnitude, 4)) {
+      columns.magnitude = column;
+    } else if (matches(name, color, 4)) {
+      columns.color = column;
+    }
+    field = next;
+  }
+  return columns.ra >= 0 && columns.dec >= 0 && columns.magnitude >= 0;
+}
+
+// Function to read a row of a catalogue into a star, keeping its magnitude
+// for later. Returns false if a field is not a number, and leaves the
+// magnitude undefined if the row lacks a position or a magnitude
+bool readCatalogueRow(const char *line, const CatalogueColumns &columns,
+                      StarVertex &star, GLfloat &magnitude) {
+  double values[4] = {NAN, NAN, NAN, NAN}; // ra, dec, magnitude, color
+  int wanted[4] = {columns.ra, columns.dec, columns.magnitude, columns.color};
+  int column = 0;
+  for (const char *field = line; field != nullptr; column++) {
+    const char *next = strchr(field, ',');
+    for (int i = 0; i < 4; i++) {
+      if (wanted[i] != column) {
+        continue;
+      }
+      const char *start = field;
+      while (*start == ' ' || *start == '"') {
+        start++;
+      }
+      char *end;
+      values[i] = strtod(start, &end);
+      if (end == start) {
+        values[i] = NAN; // an empty field
+      }
+      while (*end == ' ' || *end == '\r' || *end == '"') {
+        end++;
+      }
+      if ((*end != ',' && *end != '\0') || std::isinf(values[i])) {
+        return false;
+      }
+    }
+    field = next != nullptr ? next + 1 : nullptr;
+  }
+
+  magnitude = values[2];
+  if (std::isnan(values[0]) || std::isnan(values[1])) {
+    magnitude = NAN;
+    return true;
+  }
+
+  // The north celestial pole is up, and the right ascension turns around it
+  GLfloat ra = values[0] * M_PI / 180, dec = values[1] * M_PI / 180;
+  GLfloat tint[3] = {1, 1, 1};
+  if (!std::isnan(values[3])) {
+    starTint(values[3], tint);
+  }
+  star.x = cosf(dec) * cosf(ra);
+  star.y = sinf(dec);
+  star.z = -cosf(dec) * sinf(ra);
+  for (int c = 0; c < 3; c++) {
+    star.color[c] = tint[c] * 255;
+  }
+  star.color[3] = 255;
+  return true;
+}
+
+// Function to stream a star catalogue in CSV form, with a header naming its
+// columns (right ascension and declination in degrees, magnitude and
+// optionally a color index, as in Hipparcos or Gaia extracts), into packed
+// stars. The file is read in blocks whose rows are parsed in parallel, and
+// the stars are shaded from the brightest to the faintest of the catalogue
+bool loadStarCatalogue(const std::string &path, std::vector<StarVertex> &stars,
+                       ThreadPool &pool) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Could not open star catalogue '" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  stars.clear();
+  std::vector<GLfloat> magnitudes;
+  std::vector<char> block(catalogueBlockSize + 1);
+  std::vector<char *> rows;
+  std::vector<char> valid;
+  CatalogueColumns columns;
+  bool header = false;
+  size_t kept = 0; // bytes of an unfinished row carried to the next block
+  long lineNumber = 0;
+  const char *problem = nullptr;
+  while (problem == nullptr) {
+    size_t read = fread(block.data() + kept, 1, block.size() - 1 - kept, file);
+    size_t size = kept + read;
+    bool last = read == 0;
+    if (size == 0) {
+      break;
+    }
+    char *end = last ? block.data() + size
+                     : (char *)memrchr(block.data(), '\n', size);
+    if (end == nullptr) {
+      problem = "has a row longer than a block";
+      break;
+    }
+    *end = '\0';
+
+    // The rows of the block are found serially, and parsed in parallel
+    rows.clear();
+    long firstLine = lineNumber + 1;
+    for (char *line = block.data(); line != nullptr; lineNumber++) {
+      char *next = strchr(line, '\n');
+      if (next != nullptr) {
+        *next++ = '\0';
+      }
+      if (*line == '#' || *line == '\0' || *line == '\r') {
+        rows.push_back(nullptr);
+      } else if (!header) {
+        header = true;
+        rows.push_back(nullptr);
+        if (!readCatalogueHeader(line, columns)) {
+          problem = "lacks a ra, dec or magnitude column";
+          break;
+        }
+      } else {
+        rows.push_back(line);
+      }
+      line = next;
+    }
+    if (problem != nullptr) {
+      break;
+    }
+
+    size_t base = stars.size();
+    stars.resize(base + rows.size());
+    magnitudes.resize(base + rows.size());
+    valid.assign(rows.size(), 1);
+    parallelFor(pool, 0, rows.size(), chunkSizeFor(pool, rows.size(), 1024),
+                [&](size_t begin, size_t end, unsigned int) {
+                  for (size_t i = begin; i < end; i++) {
+                    magnitudes[base + i] = NAN;
+                    if (rows[i] != nullptr) {
+                      valid[i] = readCatalogueRow(rows[i], columns,
+                                                  stars[base + i],
+                                                  magnitudes[base + i]);
+                    }
+                  }
+                });
+    for (size_t i = 0; i < rows.size() && problem == nullptr; i++) {
+      if (!valid[i]) {
+        std::cerr << "Invalid star at line " << firstLine + i << " of '"
+                  << path << "'." << std::endl;
+        problem = "is malformed";
+      }
+    }
+
+    // Only the stars with a position and a magnitude are kept
+    size_t count = base;
+    for (size_t i = base; i < stars.size(); i++) {
+      if (!std::isnan(magnitudes[i])) {
+        stars[count] = stars[i];
+        magnitudes[count++] = magnitudes[i];
+      }
+    }
+    stars.resize(count);
+    magnitudes.resize(count);
+
+    kept = last ? 0 : block.data() + size - (end + 1);
+    memmove(block.data(), end + 1, kept);
+    if (last) {
+      break;
+    }
+  }
+  fclose(file);
+  if (problem == nullptr && !header) {
+    problem = "is empty";
+  }
+  if (problem != nullptr) {
+    std::cerr << "The star catalogue '" << path << "' " << problem << "."
+              << std::endl;
+    return false;
+  }
+
+  auto range = std::minmax_element(magnitudes.begin(), magnitudes.end());
+  GLfloat brightest = stars.empty() ? 0 : *range.first;
+  GLfloat span = stars.empty() ? 1 : std::max(*range.second - brightest, 1.0f);
+  parallelFor(pool, 0, stars.size(), chunkSizeFor(pool, stars.size(), 4096),
+              [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i = begin; i < end; i++) {
+                  // Magnitudes are already logarithmic, so the gray level
+                  // follows them linearly
+                  GLfloat level = 1 - (1 - catalogueFaintestLevel) *
+                                          (magnitudes[i] - brightest) / span;
+                  for (int c = 0; c < 3; c++) {
+                    stars[i].color[c] *= level;
+                  }
+                }
+              });
+  return true;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef STAR_FIELD_HPP
+#define STAR_FIELD_HPP
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "../Structs/Coordinates.hpp"
+#include <GL/glut.h>
+#include <cstddef>
+#include <vector>
+
+// Define the layout of a star in the vertex buffer: its direction and its
+// gray level, packed in 16 bytes
+struct StarVertex {
+  GLfloat x, y, z;
+  GLubyte color[4];
+};
+
+// Define a structure for the star field stored in a vertex buffer
+struct StarField {
+  GLuint buffer = 0;
+  GLsizei count = 0;
+};
+
+// Function to upload the stars to a vertex buffer. The stars never change,
+// so this is done once and the buffer is drawn with a single call afterwards
+void uploadStarField(StarField &field, const std::vector<StarVertex> &stars) {
+  if (field.buffer == 0) {
+    glGenBuffers(1, &field.buffer);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, field.buffer);
+  glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(StarVertex),
+               stars.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  field.count = stars.size();
+}
+
+// Function to draw the star field around the camera. The stars are unit
+// directions, so they are moved with the camera by a single translation
+void drawStarField(const StarField &field, Coordinates camera) {
+  glPushMatrix();
+  glTranslatef(camera.x, camera.y, camera.z);
+
+  glBindBuffer(GL_ARRAY_BUFFER, field.buffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(StarVertex),
+                  (const GLvoid *)offsetof(StarVertex, x));
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(StarVertex),
+                 (const GLvoid *)offsetof(StarVertex, color));
+  glDrawArrays(GL_POINTS, 0, field.count);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glPopMatrix();
+}
+
+#endif
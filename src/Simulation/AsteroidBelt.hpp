@@ -0,0 +1,38 @@
+#ifndef ASTEROID_BELT_HPP
+#define ASTEROID_BELT_HPP
+
+#include "../Physics/BodySystem.hpp"
+#include "../Physics/Gravity.hpp"
+#include <cmath>
+#include <random>
+
+const double astronomicalUnit = 1.495978707e11;
+
+// Function to add a belt of unnamed asteroids in circular orbits around a
+// central body, in its XZ plane, between 2.1 and 3.3 AU from it. The same
+// seed always yields the same belt
+void addAsteroidBelt(BodySystem &system, size_t centralBody, size_t count,
+                     unsigned int seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> radius(2.1 * astronomicalUnit,
+                                                3.3 * astronomicalUnit);
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  std::uniform_real_distribution<double> logMass(15, 18);
+
+  double cx = system.x[centralBody], cy = system.y[centralBody];
+  double cz = system.z[centralBody];
+  double cvx = system.vx[centralBody], cvy = system.vy[centralBody];
+  double cvz = system.vz[centralBody];
+  double mu = gravitationalConstant * system.mass[centralBody];
+
+  reserveBodies(system, system.count + count);
+  for (size_t i = 0; i < count; i++) {
+    double r = radius(generator), theta = angle(generator);
+    double speed = sqrt(mu / r);
+    addBody(system, "", pow(10, logMass(generator)), cx + r * cos(theta), cy,
+            cz + r * sin(theta), cvx - speed * sin(theta), cvy,
+            cvz + speed * cos(theta));
+  }
+}
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "../Physics/BodySystem.hpp"
+#include "../Physics/Integrators.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+const char checkpointMagic[8] = {'S', 'O', 'L', 'A', 'R', 'C', 'K', 'P'};
+const uint32_t checkpointVersion = 2;
+// Written as is, so a file saved on a machine of another byte order is
+// recognized and rejected
+const uint32_t checkpointByteOrder = 0x01020304;
+// Arrays of the body system stored in a checkpoint
+const int checkpointArrays = 10;
+
+// Define the header at the start of a checkpoint file. It is followed by the
+// arrays of the body system (mass, x, y, z, vx, vy, vz, ax, ay and az), each
+// one starting at a multiple of simdAlignment, and by the names of the bodies,
+// each one ended by a null character
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t headerSize;
+  uint64_t count;
+  uint64_t arraysOffset, arrayStride; // in bytes, from the start of the file
+  uint64_t namesOffset, namesSize;
+  uint64_t fileSize;
+  // State of the integrator
+  double time, timestep, accuracy, minTimestep, adaptiveStep;
+  int64_t forceEvaluations;
+  int32_t integratorKind, maxRefinement;
+  uint32_t accelerationsValid;
+  uint32_t reserved;
+};
+
+// Define a structure writing checkpoints on its own thread, so the
+// simulation only stops to copy its state
+struct CheckpointWriter {
+  std::thread thread;
+  std::vector<char> image;
+};
+
+// Function to round a size up to a multiple of simdAlignment
+uint64_t alignCheckpointOffset(uint64_t offset) {
+  return (offset + simdAlignment - 1) / simdAlignment * simdAlignment;
+}
+
+// Function to list the arrays of the body system in their order in a
+// checkpoint
+std::vector<BodyArray *> checkpointArraysOf(BodySystem &system) {
+  return {&system.mass, &system.x,  &system.y,  &system.z,  &system.vx,
+          &system.vy,   &system.vz, &system.ax, &system.ay, &system.az};
+}
+
+// Function to lay out the whole checkpoint file of a state in memory
+void encodeCheckpoint(BodySystem &system, const Integrator &integrator,
+                      std::vector<char> &image) {
+  CheckpointHeader header{};
+  memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+  header.version = checkpointVersion;
+  header.byteOrder = checkpointByteOrder;
+  header.headerSize = sizeof(CheckpointHeader);
+  header.count = system.count;
+  header.arraysOffset = alignCheckpointOffset(sizeof(CheckpointHeader));
+  header.arrayStride = alignCheckpointOffset(system.count * sizeof(double));
+  header.namesOffset =
+      header.arraysOffset + checkpointArrays * header.arrayStride;
+  for (const std::string &name : system.names) {
+    header.namesSize += name.size() + 1;
+  }
+  header.fileSize = header.namesOffset + header.namesSize;
+
+  header.time = integrator.time;
+  header.timestep = integrator.timestep;
+  header.accuracy = integrator.accuracy;
+  header.minTimestep = integrator.minTimestep;
+  header.adaptiveStep = integrator.adaptiveStep;
+  header.forceEvaluations = integrator.forceEvaluations;
+  header.integratorKind = integrator.kind;
+  header.maxRefinement = integrator.maxRefinement;
+  header.accelerationsValid = integrator.accelerationsValid;
+
+  // The padding between the arrays is left zeroed
+  image.assign(header.fileSize, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  char *array = image.data() + header.arraysOffset;
+  for (BodyArray *values : checkpointArraysOf(system)) {
+    memcpy(array, values->data(), system.count * sizeof(double));
+    array += header.arrayStride;
+  }
+  char *name = image.data() + header.namesOffset;
+  for (const std::string &value : system.names) {
+    memcpy(name, value.c_str(), value.size() + 1);
+    name += value.size() + 1;
+  }
+}
+
+// Function to write a checkpoint image to a file. It is written to a
+// temporary file first, so an interrupted save never leaves a truncated
+// checkpoint behind
+bool writeCheckpointFile(const std::string &path,
+                         const std::vector<char> &image) {
+  std::string temporaryPath = path + ".tmp";
+  FILE *file = fopen(temporaryPath.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Could not create checkpoint file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+  bool written = fwrite(image.data(), 1, image.size(), file) == image.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    std::cerr << "Could not write checkpoint file '" << path << "'."
+              << std::endl;
+    remove(temporaryPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Function to save the state of a simulation to a checkpoint file
+bool saveCheckpoint(const std::string &path, BodySystem &system,
+                    const Integrator &integrator) {
+  std::vector<char> image;
+  encodeCheckpoint(system, integrator, image);
+  return writeCheckpointFile(path, image);
+}
+
+// Function to wait for the checkpoint being written, if any
+void finishCheckpointWrite(CheckpointWriter &writer) {
+  if (writer.thread.joinable()) {
+    writer.thread.join();
+  }
+}
+
+// Function to copy the state of a simulation and write it to a checkpoint
+// file in the background. The previous checkpoint is finished first
+void startCheckpointWrite(CheckpointWriter &writer, const std::string &path,
+                          BodySystem &system, const Integrator &integrator) {
+  finishCheckpointWrite(writer);
+  encodeCheckpoint(system, integrator, writer.image);
+  double time = integrator.time;
+  writer.thread = std::thread([&writer, path, time]() {
+    if (writeCheckpointFile(path, writer.image)) {
+      std::cout << "Saved checkpoint '" << path << "' at " << time << " s."
+                << std::endl;
+    }
+  });
+}
+
+// Function to check that a mapped file is a checkpoint this program can read
+bool validCheckpoint(const char *data, size_t size, const std::string &path) {
+  const CheckpointHeader *header = (const CheckpointHeader *)data;
+  const char *problem = nullptr;
+  if (size < sizeof(checkpointMagic) ||
+      memcmp(header->magic, checkpointMagic, sizeof(header->magic)) != 0) {
+    problem = "is not a checkpoint";
+  } else if (size < sizeof(CheckpointHeader)) {
+    problem = "is truncated";
+  } else if (header->version != checkpointVersion) {
+    problem = "has an unsupported version";
+  } else if (header->byteOrder != checkpointByteOrder) {
+    problem = "was saved on a machine of another byte order";
+  } else if (header->headerSize != sizeof(CheckpointHeader) ||
+             header->fileSize != size ||
+             header->arrayStride < header->count * sizeof(double) ||
+             header->arraysOffset < sizeof(CheckpointHeader) ||
+             header->namesOffset !=
+                 header->arraysOffset +
+                     checkpointArrays * header->arrayStride ||
+             header->namesOffset + header->namesSize != size ||
+             header->integratorKind < SEMI_IMPLICIT_EULER ||
+             header->integratorKind > ADAPTIVE_LEAPFROG) {
+    problem = "is truncated or corrupted";
+  }
+
+  if (problem != nullptr) {
+    std::cerr << "The file '" << path << "' " << problem << "." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Function to restore the state of a simulation from a checkpoint file. The
+// file is mapped in memory and its arrays are copied as they are, without
+// any parsing
+bool loadCheckpoint(const std::string &path, BodySystem &system,
+                    Integrator &integrator) {
+  int descriptor = open(path.c_str(), O_RDONLY);
+  struct stat status;
+  if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+    std::cerr << "Could not open checkpoint file '" << path << "'."
+              << std::endl;
+    if (descriptor >= 0) {
+      close(descriptor);
+    }
+    return false;
+  }
+
+  size_t size = status.st_size;
+  void *mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+                                  descriptor, 0)
+                           : MAP_FAILED;
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Could not map checkpoint file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+  const char *data = (const char *)mapping;
+  if (!validCheckpoint(data, size, path)) {
+    munmap(mapping, size);
+    return false;
+  }
+  const CheckpointHeader &header = *(const CheckpointHeader *)data;
+
+  // The names are checked before anything is changed
+  std::vector<std::string> names;
+  const char *name = data + header.namesOffset;
+  const char *namesEnd = name + header.namesSize;
+  while (name < namesEnd && names.size() < header.count) {
+    const char *end = (const char *)memchr(name, '\0', namesEnd - name);
+    if (end == nullptr) {
+      break;
+    }
+    names.emplace_back(name, end);
+    name = end + 1;
+  }
+  if (names.size() != header.count || name != namesEnd) {
+    std::cerr << "The names in '" << path << "' are corrupted." << std::endl;
+    munmap(mapping, size);
+    return false;
+  }
+
+  system = BodySystem();
+  system.count = header.count;
+  const double *array = (const double *)(data + header.arraysOffset);
+  for (BodyArray *values : checkpointArraysOf(system)) {
+    values->assign(array, array + header.count);
+    array += header.arrayStride / sizeof(double);
+  }
+  system.names = std::move(names);
+  system.ids.resize(system.count);
+  for (size_t i = 0; i < system.count; i++) {
+    system.ids[i] = i;
+  }
+  system.nextId = system.count;
+  for (size_t i = 0; i < system.count; i++) {
+    if (!system.names[i].empty()) {
+      system.indexByName[system.names[i]] = i;
+    }
+  }
+
+  integrator.kind = IntegratorKind(header.integratorKind);
+  integrator.time = header.time;
+  integrator.timestep = header.timestep;
+  integrator.accuracy = header.accuracy;
+  integrator.minTimestep = header.minTimestep;
+  integrator.maxRefinement = header.maxRefinement;
+  integrator.adaptiveStep = header.adaptiveStep;
+  integrator.forceEvaluations = header.forceEvaluations;
+  integrator.accelerationsValid = header.accelerationsValid != 0;
+
+  munmap(mapping, size);
+  return true;
+}
+
+#endif
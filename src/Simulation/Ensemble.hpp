@@ -0,0 +1,448 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include "../Parallel/ThreadPool.hpp"
+#include "../Physics/BodySystem.hpp"
+#include "../Physics/Gravity.hpp"
+#include "../Physics/Integrators.hpp"
+#include "Scenario.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Blocks of members given to each worker between two writes of the results
+const size_t ensembleBlocksPerWorker = 4;
+
+// Quantities of a body changed by a perturbation
+enum PerturbedQuantity {
+  PERTURB_MASS,
+  PERTURB_X,
+  PERTURB_Y,
+  PERTURB_Z,
+  PERTURB_VX,
+  PERTURB_VY,
+  PERTURB_VZ
+};
+const char *perturbedQuantityNames[] = {"mass", "x",  "y", "z",
+                                        "vx",   "vy", "vz"};
+const int perturbedQuantities = 7;
+
+// Define a perturbation of the initial conditions of the members: a draw
+// from a normal distribution of the given standard deviation, or from a
+// uniform one of the given half width, added to a quantity of a body, or
+// added to one and multiplying the quantity if it is relative. A change of
+// position or velocity moves the children of the body along with it
+struct Perturbation {
+  int32_t body;
+  PerturbedQuantity quantity;
+  bool normal;
+  double size;
+  bool relative;
+};
+
+// Define the members of an ensemble, drawn from a base scenario
+struct EnsembleSpec {
+  long members = 0;
+  unsigned int seed = 0;
+  std::vector<Perturbation> perturbations;
+};
+
+// Define a block of ensembleLanes members, stored body-major, so the values
+// of a body in every member of the block are consecutive lanes of the lane
+// kernels
+struct EnsembleBlock {
+  size_t bodies = 0;
+  BodyArray mass, x, y, z, vx, vy, vz, ax, ay, az;
+  BodyArray closest, farthest; // squared distances to the parents
+  std::vector<double> draws;   // by perturbation, then by lane
+  double energy[ensembleLanes];
+};
+
+// Function to load an ensemble file. Each line holds one entry:
+//   members COUNT
+//   seed SEED
+//   perturb BODY QUANTITY normal|uniform SIZE [relative]
+// where QUANTITY is mass, x, y, z, vx, vy or vz, in SI units, and BODY is a
+// named body of the scenario. Lines starting with '#' are comments
+bool loadEnsembleSpec(const std::string &path, const Scenario &scenario,
+                      EnsembleSpec &spec) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Could not open ensemble file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  std::unordered_map<std::string, int32_t> ids;
+  for (size_t i = 0; i < scenario.count && !scenario.names[i].empty(); i++) {
+    ids[scenario.names[i]] = i;
+  }
+
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    std::istringstream stream(line);
+    std::string keyword, body, quantity, distribution, relative;
+    if (!(stream >> keyword) || keyword[0] == '#') {
+      continue;
+    }
+
+    const char *problem = nullptr;
+    long number;
+    if (keyword == "members") {
+      if (!(stream >> number) || number <= 0) {
+        problem = "invalid member count";
+      }
+      spec.members = number;
+    } else if (keyword == "seed") {
+      if (!(stream >> number) || number < 0) {
+        problem = "invalid seed";
+      }
+      spec.seed = number;
+    } else if (keyword == "perturb") {
+      Perturbation perturbation{};
+      stream >> body >> quantity >> distribution >> perturbation.size;
+      const char **name =
+          std::find(perturbedQuantityNames,
+                    perturbedQuantityNames + perturbedQuantities, quantity);
+      if (!stream || perturbation.size < 0 ||
+          (distribution != "normal" && distribution != "uniform") ||
+          name == perturbedQuantityNames + perturbedQuantities ||
+          ((stream >> relative) && relative != "relative")) {
+        problem = "invalid perturbation";
+      } else if (ids.count(body) == 0) {
+        problem = "unknown body";
+      } else {
+        perturbation.body = ids[body];
+        perturbation.quantity =
+            PerturbedQuantity(name - perturbedQuantityNames);
+        perturbation.normal = distribution == "normal";
+        perturbation.relative = relative == "relative";
+        spec.perturbations.push_back(perturbation);
+      }
+    } else {
+      problem = "unknown entry";
+    }
+
+    std::string rest;
+    if (problem == nullptr && (stream >> rest) && rest[0] != '#') {
+      problem = "unexpected values at the end of the line";
+    }
+    if (problem != nullptr) {
+      std::cerr << "Line " << lineNumber << " of '" << path << "': "
+                << problem << "." << std::endl;
+      return false;
+    }
+  }
+
+  if (spec.members == 0) {
+    std::cerr << "The ensemble file '" << path << "' gives no member count."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Function to draw a uniform number in (0, 1]
+double ensembleUniform(std::mt19937_64 &generator) {
+  return ((generator() >> 11) + 1) * 0x1.0p-53;
+}
+
+// Function to draw the perturbations of a member, which only depend on the
+// seed and the member, and to set its initial state in a lane of a block
+void initializeMember(EnsembleBlock &block, const Scenario &scenario,
+                      const EnsembleSpec &spec, long member, size_t lane) {
+  std::seed_seq sequence{spec.seed, (unsigned int)member,
+                         (unsigned int)(member >> 32)};
+  std::mt19937_64 generator(sequence);
+  size_t bodies = scenario.count;
+  // Changes of x, y, z, vx, vy and vz of each body
+  std::vector<double> shift(6 * bodies, 0);
+  for (size_t i = 0; i < bodies; i++) {
+    block.mass[i * ensembleLanes + lane] = scenario.mass[i];
+  }
+
+  for (size_t p = 0; p < spec.perturbations.size(); p++) {
+    const Perturbation &perturbation = spec.perturbations[p];
+    double draw;
+    if (perturbation.normal) {
+      // Box-Muller transform, so the draws do not depend on the library
+      double u1 = ensembleUniform(generator), u2 = ensembleUniform(generator);
+      draw = perturbation.size * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+    } else {
+      draw = perturbation.size * (2 * ensembleUniform(generator) - 1);
+    }
+    block.draws[p * ensembleLanes + lane] = draw;
+
+    size_t body = perturbation.body;
+    const std::vector<double> *bases[] = {
+        &scenario.mass, &scenario.x,  &scenario.y, &scenario.z,
+        &scenario.vx,   &scenario.vy, &scenario.vz};
+    double base = (*bases[perturbation.quantity])[body];
+    double change = perturbation.relative ? base * draw : draw;
+    if (perturbation.quantity == PERTURB_MASS) {
+      block.mass[body * ensembleLanes + lane] += change;
+    } else {
+      shift[6 * body + perturbation.quantity - PERTURB_X] += change;
+    }
+  }
+
+  // The parents come before their children, so the shift of a parent is
+  // complete when its children take it
+  for (size_t i = 0; i < bodies; i++) {
+    int32_t parent = scenario.parents[i];
+    for (int k = 0; parent >= 0 && k < 6; k++) {
+      shift[6 * i + k] += shift[6 * parent + k];
+    }
+    size_t slot = i * ensembleLanes + lane;
+    block.x[slot] = scenario.x[i] + shift[6 * i];
+    block.y[slot] = scenario.y[i] + shift[6 * i + 1];
+    block.z[slot] = scenario.z[i] + shift[6 * i + 2];
+    block.vx[slot] = scenario.vx[i] + shift[6 * i + 3];
+    block.vy[slot] = scenario.vy[i] + shift[6 * i + 4];
+    block.vz[slot] = scenario.vz[i] + shift[6 * i + 5];
+  }
+}
+
+// Function to compute the accelerations of every body of every member of a
+// block, visiting each pair of bodies once
+void ensembleAccelerations(EnsembleBlock &block) {
+  for (BodyArray *array : {&block.ax, &block.ay, &block.az}) {
+    std::fill(array->begin(), array->end(), 0);
+  }
+  for (size_t i = 0; i < block.bodies; i++) {
+    size_t a = i * ensembleLanes;
+    for (size_t j = i + 1; j < block.bodies; j++) {
+      size_t b = j * ensembleLanes;
+      pullLanes({&block.x[a], &block.y[a], &block.z[a], &block.mass[a],
+                 &block.ax[a], &block.ay[a], &block.az[a]},
+                {&block.x[b], &block.y[b], &block.z[b], &block.mass[b],
+                 &block.ax[b], &block.ay[b], &block.az[b]});
+    }
+  }
+  for (BodyArray *array : {&block.ax, &block.ay, &block.az}) {
+    for (double &value : *array) {
+      value *= gravitationalConstant;
+    }
+  }
+}
+
+// Function to add an array of a block times a factor to another one. Each
+// axis is a separate loop, which the compiler vectorizes
+void addScaledLanes(BodyArray &target, const BodyArray &source,
+                    double factor) {
+  double *out = target.data();
+  const double *in = source.data();
+  for (size_t k = 0; k < target.size(); k++) {
+    out[k] += in[k] * factor;
+  }
+}
+
+// Function to change every velocity of a block by its acceleration over dt
+void kickEnsemble(EnsembleBlock &block, double dt) {
+  addScaledLanes(block.vx, block.ax, dt);
+  addScaledLanes(block.vy, block.ay, dt);
+  addScaledLanes(block.vz, block.az, dt);
+}
+
+// Function to move every body of a block along its velocity over dt
+void driftEnsemble(EnsembleBlock &block, double dt) {
+  addScaledLanes(block.x, block.vx, dt);
+  addScaledLanes(block.y, block.vy, dt);
+  addScaledLanes(block.z, block.vz, dt);
+}
+
+// Function to advance every member of a block by one step of the given
+// scheme, leapfrog or Yoshida's fourth order one. The accelerations must
+// match the positions at the start of a leapfrog step
+void stepEnsemble(EnsembleBlock &block, IntegratorKind kind, double dt) {
+  if (kind == LEAPFROG) {
+    kickEnsemble(block, dt / 2);
+    driftEnsemble(block, dt);
+    ensembleAccelerations(block);
+    kickEnsemble(block, dt / 2);
+    return;
+  }
+
+  double driftWeights[4], kickWeights[3];
+  yoshida4Weights(driftWeights, kickWeights);
+  for (int k = 0; k < 3; k++) {
+    driftEnsemble(block, driftWeights[k] * dt);
+    ensembleAccelerations(block);
+    kickEnsemble(block, kickWeights[k] * dt);
+  }
+  driftEnsemble(block, driftWeights[3] * dt);
+}
+
+// Function to update the closest and farthest distances of the bodies of a
+// block to their parents
+void trackParentDistances(EnsembleBlock &block, const Scenario &scenario) {
+  for (size_t i = 0; i < block.bodies; i++) {
+    int32_t parent = scenario.parents[i];
+    if (parent < 0) {
+      continue;
+    }
+    for (size_t l = 0; l < ensembleLanes; l++) {
+      size_t a = i * ensembleLanes + l, b = parent * ensembleLanes + l;
+      double dx = block.x[a] - block.x[b], dy = block.y[a] - block.y[b];
+      double dz = block.z[a] - block.z[b];
+      double distance2 = dx * dx + dy * dy + dz * dz;
+      block.closest[a] = std::min(block.closest[a], distance2);
+      block.farthest[a] = std::max(block.farthest[a], distance2);
+    }
+  }
+}
+
+// Function to compute the total energy of each member of a block
+void ensembleEnergy(const EnsembleBlock &block, double *energy) {
+  for (size_t l = 0; l < ensembleLanes; l++) {
+    double kinetic = 0, potential = 0;
+    for (size_t i = 0; i < block.bodies; i++) {
+      size_t a = i * ensembleLanes + l;
+      kinetic += block.mass[a] *
+                 (block.vx[a] * block.vx[a] + block.vy[a] * block.vy[a] +
+                  block.vz[a] * block.vz[a]) /
+                 2;
+      for (size_t j = i + 1; j < block.bodies; j++) {
+        size_t b = j * ensembleLanes + l;
+        double dx = block.x[b] - block.x[a], dy = block.y[b] - block.y[a];
+        double dz = block.z[b] - block.z[a];
+        double r = sqrt(dx * dx + dy * dy + dz * dz);
+        if (r > 0) {
+          potential -=
+              gravitationalConstant * block.mass[a] * block.mass[b] / r;
+        }
+      }
+    }
+    energy[l] = kinetic + potential;
+  }
+}
+
+// Function to integrate a block of members over the horizon of the scenario
+void integrateEnsembleBlock(EnsembleBlock &block, const Scenario &scenario,
+                            const EnsembleSpec &spec, long firstMember,
+                            IntegratorKind kind, double timestep) {
+  size_t slots = scenario.count * ensembleLanes;
+  block.bodies = scenario.count;
+  for (BodyArray *array :
+       {&block.mass, &block.x, &block.y, &block.z, &block.vx, &block.vy,
+        &block.vz, &block.ax, &block.ay, &block.az}) {
+    array->resize(slots);
+  }
+  block.closest.assign(slots, INFINITY);
+  block.farthest.assign(slots, 0);
+  block.draws.resize(spec.perturbations.size() * ensembleLanes);
+
+  // The lanes past the last member run a copy of it, which is never reported
+  for (size_t l = 0; l < ensembleLanes; l++) {
+    initializeMember(block, scenario, spec,
+                     std::min<long>(firstMember + l, spec.members - 1), l);
+  }
+  ensembleEnergy(block, block.energy);
+  ensembleAccelerations(block);
+  trackParentDistances(block, scenario);
+
+  for (double remaining = scenario.horizon; remaining > 0;) {
+    double dt = std::min(timestep, remaining);
+    stepEnsemble(block, kind, dt);
+    trackParentDistances(block, scenario);
+    remaining -= dt;
+  }
+}
+
+// Function to write the header of the summary of the members: the draws of
+// the perturbations, the relative change of the energy, and the closest,
+// farthest and final distance of each named body with a parent to it
+void writeEnsembleHeader(const Scenario &scenario, const EnsembleSpec &spec,
+                         std::ostream &out) {
+  out << "member";
+  for (const Perturbation &perturbation : spec.perturbations) {
+    out << "," << scenario.names[perturbation.body] << "."
+        << perturbedQuantityNames[perturbation.quantity];
+  }
+  out << ",energy_error";
+  for (size_t i = 0; i < scenario.count && !scenario.names[i].empty(); i++) {
+    if (scenario.parents[i] >= 0) {
+      const std::string &name = scenario.names[i];
+      out << "," << name << ".min_distance," << name << ".max_distance,"
+          << name << ".final_distance";
+    }
+  }
+  out << "\n";
+}
+
+// Function to format the summary of the members of an integrated block
+std::string summarizeEnsembleBlock(const EnsembleBlock &block,
+                                   const Scenario &scenario,
+                                   const EnsembleSpec &spec,
+                                   long firstMember) {
+  double energy[ensembleLanes];
+  ensembleEnergy(block, energy);
+  std::ostringstream rows;
+  rows.precision(9);
+  for (size_t l = 0; l < ensembleLanes && firstMember + (long)l < spec.members;
+       l++) {
+    rows << firstMember + l;
+    for (size_t p = 0; p < spec.perturbations.size(); p++) {
+      rows << "," << block.draws[p * ensembleLanes + l];
+    }
+    rows << "," << (energy[l] - block.energy[l]) / fabs(block.energy[l]);
+    for (size_t i = 0; i < scenario.count && !scenario.names[i].empty();
+         i++) {
+      int32_t parent = scenario.parents[i];
+      if (parent < 0) {
+        continue;
+      }
+      size_t a = i * ensembleLanes + l, b = parent * ensembleLanes + l;
+      double dx = block.x[a] - block.x[b], dy = block.y[a] - block.y[b];
+      double dz = block.z[a] - block.z[b];
+      rows << "," << sqrt(block.closest[a]) << "," << sqrt(block.farthest[a])
+           << "," << sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    rows << "\n";
+  }
+  return rows.str();
+}
+
+// Function to run every member of an ensemble, in blocks of ensembleLanes
+// members spread over the workers of the pool. The blocks are run in waves,
+// and the summary of each wave is written before the next one starts, so
+// the results come out as they are computed, in the order of the members
+bool runEnsemble(const Scenario &scenario, const EnsembleSpec &spec,
+                 IntegratorKind kind, double timestep, ThreadPool &pool,
+                 std::ostream &out) {
+  writeEnsembleHeader(scenario, spec, out);
+  size_t blocks = (spec.members + ensembleLanes - 1) / ensembleLanes;
+  size_t wave = workerCount(pool) * ensembleBlocksPerWorker;
+  std::vector<EnsembleBlock> scratch(workerCount(pool));
+  std::vector<std::string> rows(wave);
+
+  for (size_t first = 0; first < blocks && out; first += wave) {
+    size_t last = std::min(first + wave, blocks);
+    parallelFor(pool, first, last, 1,
+                [&](size_t begin, size_t end, unsigned int worker) {
+                  for (size_t b = begin; b < end; b++) {
+                    long member = b * ensembleLanes;
+                    integrateEnsembleBlock(scratch[worker], scenario, spec,
+                                           member, kind, timestep);
+                    rows[b - first] = summarizeEnsembleBlock(
+                        scratch[worker], scenario, spec, member);
+                  }
+                });
+    for (size_t b = first; b < last; b++) {
+      out << rows[b - first];
+    }
+    out.flush();
+  }
+  return bool(out);
+}
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include "../Physics/GravitySolver.hpp"
+#include "../Physics/Integrators.hpp"
+#include "Scenario.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Define a structure for holding the options given in the command line
+struct Options {
+  bool headless = false;
+  std::string scenarioPath; // empty loads the default scenario of the mode
+  std::string compiledScenarioPath; // compiles the scenario there, if given
+  long asteroids = 0;
+  long stars = 100000;
+  long ringParticles = -1; // particles per ring, -1 keeps the scenario ones
+  std::string starCatalogue; // CSV file of stars, if not empty
+  unsigned int seed = 42;
+  SolverKind solver = DIRECT_SUM;
+  float theta = 0.5;
+  float softening = 0; // in meters
+  bool collisions = false;
+  unsigned int threads = 0; // 0 uses one thread per core
+  IntegratorKind integrator = LEAPFROG;
+  float timestep = 0; // 0 keeps the default step of the mode
+  float accuracy = 0.01;
+  // Named bodies placed on their orbits instead of integrated, or "all"
+  std::vector<std::string> ephemerisBodies;
+  bool offscreen = false;
+  long frames = 300;
+  float fps = 30;
+  long frameWidth = 1280, frameHeight = 720;
+  std::string cameraPath; // empty keeps the default camera
+  std::string frameOutput = "frame%05d.ppm";
+  bool profile = false;
+  std::string profilePath; // CSV file written at exit, if not empty
+  std::string checkpointPath; // empty saves to the default checkpoint
+  std::string restorePath;    // empty starts from the initial bodies
+  std::string recordPath; // trajectory file, if not empty
+  float recordQuantum = 1000; // in meters
+  long trailBodies = 0; // 0 gives a trail to the bodies drawn one by one
+  long trailLength = 256;    // samples per trail
+  long trailDecimation = 4;  // physics ticks per sample
+  std::string ensemblePath;            // ensemble file, if not empty
+  std::string ensembleCsv = "ensemble.csv"; // "-" for the standard output
+  bool benchmark = false;
+  std::string benchmarkPath; // CSV file of the results, if not empty
+  std::vector<long> benchmarkSizes = {10, 1000, 100000, 1000000};
+};
+
+// Function to read the value of an option written as "--name=value". Returns
+// nullptr if the argument is not the given option
+const char *optionValue(const char *argument, const char *name) {
+  size_t length = strlen(name);
+  if (strncmp(argument, name, length) == 0 && argument[length] == '=') {
+    return argument + length + 1;
+  }
+  return nullptr;
+}
+
+// Function to read a non-negative integer option value
+bool parseCount(const char *value, long &count) {
+  char *end;
+  count = strtol(value, &end, 10);
+  return *value != '\0' && *end == '\0' && count >= 0;
+}
+
+// Function to read a positive real option value
+bool parsePositive(const char *value, float &number) {
+  char *end;
+  number = strtof(value, &end);
+  return *value != '\0' && *end == '\0' && number > 0;
+}
+
+// Function to read a frame size written as "WIDTHxHEIGHT"
+bool parseSize(const char *value, long &width, long &height) {
+  char *end;
+  width = strtol(value, &end, 10);
+  if (end == value || *end != 'x') {
+    return false;
+  }
+  const char *heightValue = end + 1;
+  height = strtol(heightValue, &end, 10);
+  return *heightValue != '\0' && *end == '\0' && width > 0 && height > 0;
+}
+
+// Function to read a comma separated list of positive integers
+bool parseCountList(const char *value, std::vector<long> &counts) {
+  counts.clear();
+  while (*value != '\0') {
+    char *end;
+    long count = strtol(value, &end, 10);
+    if (end == value || count <= 0 || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    counts.push_back(count);
+    value = *end == ',' ? end + 1 : end;
+  }
+  return !counts.empty();
+}
+
+// Function to read a comma separated list of names
+bool parseNameList(const char *value, std::vector<std::string> &names) {
+  names.clear();
+  while (*value != '\0') {
+    const char *end = strchr(value, ',');
+    if (end == nullptr) {
+      end = value + strlen(value);
+    }
+    if (end == value) {
+      return false;
+    }
+    names.emplace_back(value, end);
+    value = *end == ',' ? end + 1 : end;
+  }
+  return !names.empty();
+}
+
+// Function to parse the command line arguments into the options structure
+bool parseOptions(int argc, char **argv, Options &options) {
+  const char *value;
+  long number;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      options.headless = true;
+      // The scenario path is optional
+      if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+        options.scenarioPath = argv[++i];
+      }
+    } else if ((value = optionValue(argv[i], "--scenario"))) {
+      options.scenarioPath = value;
+    } else if ((value = optionValue(argv[i], "--compile-scenario"))) {
+      options.compiledScenarioPath = value;
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      options.profile = true;
+    } else if ((value = optionValue(argv[i], "--profile-csv"))) {
+      options.profile = true;
+      options.profilePath = value;
+    } else if ((value = optionValue(argv[i], "--checkpoint"))) {
+      options.checkpointPath = value;
+    } else if ((value = optionValue(argv[i], "--restore"))) {
+      options.restorePath = value;
+    } else if ((value = optionValue(argv[i], "--record"))) {
+      options.recordPath = value;
+    } else if ((value = optionValue(argv[i], "--record-quantum"))) {
+      if (!parsePositive(value, options.recordQuantum)) {
+        std::cerr << "Invalid quantum '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--trails"))) {
+      if (!parseCount(value, options.trailBodies)) {
+        std::cerr << "Invalid trail count '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--trail-length"))) {
+      if (!parseCount(value, options.trailLength) || options.trailLength < 2) {
+        std::cerr << "Invalid trail length '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--trail-decimation"))) {
+      if (!parseCount(value, options.trailDecimation) ||
+          options.trailDecimation < 1) {
+        std::cerr << "Invalid trail decimation '" << value << "'."
+                  << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--ensemble"))) {
+      options.ensemblePath = value;
+    } else if ((value = optionValue(argv[i], "--ensemble-csv"))) {
+      options.ensembleCsv = value;
+    } else if (strcmp(argv[i], "--benchmark") == 0) {
+      options.benchmark = true;
+    } else if ((value = optionValue(argv[i], "--benchmark-csv"))) {
+      options.benchmark = true;
+      options.benchmarkPath = value;
+    } else if ((value = optionValue(argv[i], "--benchmark-sizes"))) {
+      if (!parseCountList(value, options.benchmarkSizes)) {
+        std::cerr << "Invalid body counts '" << value
+                  << "' (use a comma separated list)." << std::endl;
+        return false;
+      }
+    } else if (strcmp(argv[i], "--offscreen") == 0) {
+      options.offscreen = true;
+    } else if ((value = optionValue(argv[i], "--frames"))) {
+      if (!parseCount(value, options.frames)) {
+        std::cerr << "Invalid frame count '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--fps"))) {
+      if (!parsePositive(value, options.fps)) {
+        std::cerr << "Invalid frame rate '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--size"))) {
+      if (!parseSize(value, options.frameWidth, options.frameHeight)) {
+        std::cerr << "Invalid frame size '" << value
+                  << "' (use WIDTHxHEIGHT)." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--camera-path"))) {
+      options.cameraPath = value;
+    } else if ((value = optionValue(argv[i], "--output"))) {
+      options.frameOutput = value;
+    } else if ((value = optionValue(argv[i], "--asteroids"))) {
+      if (!parseCount(value, options.asteroids)) {
+        std::cerr << "Invalid asteroid count '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--stars"))) {
+      if (!parseCount(value, options.stars)) {
+        std::cerr << "Invalid star count '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--ring-particles"))) {
+      if (!parseCount(value, options.ringParticles) ||
+          options.ringParticles > maxRingParticles) {
+        std::cerr << "Invalid ring particle count '" << value << "'."
+                  << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--star-catalogue"))) {
+      options.starCatalogue = value;
+    } else if ((value = optionValue(argv[i], "--seed"))) {
+      if (!parseCount(value, number)) {
+        std::cerr << "Invalid seed '" << value << "'." << std::endl;
+        return false;
+      }
+      options.seed = number;
+    } else if ((value = optionValue(argv[i], "--threads"))) {
+      if (!parseCount(value, number)) {
+        std::cerr << "Invalid thread count '" << value << "'." << std::endl;
+        return false;
+      }
+      options.threads = number;
+    } else if ((value = optionValue(argv[i], "--solver"))) {
+      if (strcmp(value, "direct") == 0) {
+        options.solver = DIRECT_SUM;
+      } else if (strcmp(value, "barnes-hut") == 0) {
+        options.solver = BARNES_HUT;
+      } else {
+        std::cerr << "Invalid solver '" << value
+                  << "' (use direct or barnes-hut)." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--integrator"))) {
+      if (strcmp(value, "euler") == 0) {
+        options.integrator = SEMI_IMPLICIT_EULER;
+      } else if (strcmp(value, "leapfrog") == 0) {
+        options.integrator = LEAPFROG;
+      } else if (strcmp(value, "yoshida4") == 0) {
+        options.integrator = YOSHIDA4;
+      } else if (strcmp(value, "adaptive") == 0) {
+        options.integrator = ADAPTIVE_LEAPFROG;
+      } else {
+        std::cerr << "Invalid integrator '" << value
+                  << "' (use euler, leapfrog, yoshida4 or adaptive)."
+                  << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--dt"))) {
+      if (!parsePositive(value, options.timestep)) {
+        std::cerr << "Invalid timestep '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--accuracy"))) {
+      if (!parsePositive(value, options.accuracy)) {
+        std::cerr << "Invalid accuracy '" << value << "'." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--ephemeris"))) {
+      if (!parseNameList(value, options.ephemerisBodies)) {
+        std::cerr << "Invalid body names '" << value
+                  << "' (use a comma separated list)." << std::endl;
+        return false;
+      }
+    } else if ((value = optionValue(argv[i], "--softening"))) {
+      if (!parsePositive(value, options.softening)) {
+        std::cerr << "Invalid softening length '" << value << "'."
+                  << std::endl;
+        return false;
+      }
+    } else if (strcmp(argv[i], "--collisions") == 0) {
+      options.collisions = true;
+    } else if ((value = optionValue(argv[i], "--theta"))) {
+      if (!parsePositive(value, options.theta)) {
+        std::cerr << "Invalid opening angle '" << value << "'." << std::endl;
+        return false;
+      }
+    } else {
+      std::cerr << "Argument \"" << argv[i] << "\" is not valid" << std::endl;
+      return false;
+    }
+  }
+
+  // A trajectory holds the same bodies in every frame
+  if (options.collisions && !options.recordPath.empty()) {
+    std::cerr << "Trajectories cannot be recorded with --collisions, which "
+                 "merge bodies."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+#endif
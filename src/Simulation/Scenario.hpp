@@ -0,0 +1,543 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include "../Physics/BodySystem.hpp"
+#include "../Physics/Gravity.hpp"
+#include "../Physics/Kepler.hpp"
+#include "../Structs/Color.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const char compiledScenarioMagic[8] = {'S', 'O', 'L', 'A', 'R', 'S', 'C', 'N'};
+const uint32_t compiledScenarioVersion = 3;
+const uint32_t compiledScenarioByteOrder = 0x01020304;
+// Arrays of a scenario stored in a compiled file, names excluded
+const int compiledScenarioSections = 12;
+const double defaultScenarioTimestep = 1000;
+const uint32_t defaultRingParticles = 100000;
+const float defaultRingThickness = 0.01;
+const uint32_t maxRingParticles = 100000000;
+
+// Define a ring of particles orbiting a body, with its radii and its
+// thickness given in render sizes of the body
+struct ScenarioRing {
+  int32_t body;
+  float inner, outer;
+  uint32_t particles;
+  float thickness;
+};
+
+// Define a structure for holding a simulation scenario loaded from disk. Its
+// bodies are identified by their index in the arrays, named bodies coming
+// first, and their states are absolute, in SI units, whatever their parent
+struct Scenario {
+  double timestep = defaultScenarioTimestep;
+  double horizon = 0;
+  size_t count = 0;
+  std::vector<std::string> names; // empty for bodies of a catalogue
+  std::vector<int32_t> parents;   // -1 for the bodies without a parent
+  std::vector<double> mass, x, y, z, vx, vy, vz;
+  std::vector<float> sizes; // render radius, in scene units
+  std::vector<float> spins; // rotation in degrees per 1000 s
+  std::vector<Color> colors;
+  std::vector<ScenarioRing> rings;
+};
+
+// Define the header at the start of a compiled scenario file. It is followed
+// by the arrays of the scenario, each one starting at a multiple of
+// simdAlignment, and by the names of the bodies, each one ended by a null
+// character
+struct CompiledScenarioHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t headerSize;
+  uint64_t count, ringCount;
+  double timestep, horizon;
+  uint64_t offsets[compiledScenarioSections]; // from the start of the file
+  uint64_t namesOffset, namesSize;
+  uint64_t fileSize;
+};
+
+// Define an array of a scenario as raw memory
+struct ScenarioSection {
+  void *data;
+  size_t bytes;
+};
+
+// Function to size every array of a scenario
+void resizeScenario(Scenario &scenario, size_t count, size_t ringCount) {
+  scenario.count = count;
+  scenario.names.resize(count);
+  scenario.parents.resize(count);
+  for (std::vector<double> *array :
+       {&scenario.mass, &scenario.x, &scenario.y, &scenario.z, &scenario.vx,
+        &scenario.vy, &scenario.vz}) {
+    array->resize(count);
+  }
+  scenario.sizes.resize(count);
+  scenario.spins.resize(count);
+  scenario.colors.resize(count);
+  scenario.rings.resize(ringCount);
+}
+
+// Function to list the arrays of a scenario in their order in a compiled file
+std::vector<ScenarioSection> scenarioSectionsOf(Scenario &scenario) {
+  size_t doubles = scenario.count * sizeof(double);
+  size_t floats = scenario.count * sizeof(float);
+  return {{scenario.mass.data(), doubles},
+          {scenario.x.data(), doubles},
+          {scenario.y.data(), doubles},
+          {scenario.z.data(), doubles},
+          {scenario.vx.data(), doubles},
+          {scenario.vy.data(), doubles},
+          {scenario.vz.data(), doubles},
+          {scenario.parents.data(), scenario.count * sizeof(int32_t)},
+          {scenario.sizes.data(), floats},
+          {scenario.spins.data(), floats},
+          {scenario.colors.data(), scenario.count * sizeof(Color)},
+          {scenario.rings.data(),
+           scenario.rings.size() * sizeof(ScenarioRing)}};
+}
+
+// Function to round a size up to a multiple of simdAlignment
+uint64_t alignScenarioOffset(uint64_t offset) {
+  return (offset + simdAlignment - 1) / simdAlignment * simdAlignment;
+}
+
+// Function to read a whole file in memory, ended by a null character
+bool readScenarioFile(const std::string &path, std::vector<char> &content) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Could not open scenario file '" << path << "'." << std::endl;
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  content.assign(size > 0 ? size + 1 : 1, '\0');
+  bool read = size >= 0 && fread(content.data(), 1, size, file) == (size_t)size;
+  fclose(file);
+  if (!read) {
+    std::cerr << "Could not read scenario file '" << path << "'." << std::endl;
+  }
+  return read;
+}
+
+// Function to skip the spaces of a line, returning whether the line ends
+// there or at a comment
+bool endOfScenarioLine(char *&cursor) {
+  while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+    cursor++;
+  }
+  return *cursor == '\0' || *cursor == '#';
+}
+
+// Function to cut the next word of a line. Returns nullptr at the end of the
+// line or at a comment
+char *nextScenarioWord(char *&cursor) {
+  if (endOfScenarioLine(cursor)) {
+    return nullptr;
+  }
+  char *word = cursor;
+  while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' &&
+         *cursor != '\r') {
+    cursor++;
+  }
+  if (*cursor != '\0') {
+    *cursor++ = '\0';
+  }
+  return word;
+}
+
+// Function to read the next words of a line as finite numbers
+template <typename T>
+bool readScenarioNumbers(char *&cursor, T *numbers, int count) {
+  for (int i = 0; i < count; i++) {
+    char *word = nextScenarioWord(cursor);
+    if (word == nullptr) {
+      return false;
+    }
+    char *end;
+    double number = strtod(word, &end);
+    if (*end != '\0' || !std::isfinite(number)) {
+      return false;
+    }
+    numbers[i] = number;
+  }
+  return true;
+}
+
+// Function to add a body to a scenario being parsed, from its mass, position
+// and velocity
+void pushScenarioBody(Scenario &scenario, const std::string &name,
+                      int32_t parent, const double *state, const float *look) {
+  scenario.count++;
+  scenario.names.push_back(name);
+  scenario.parents.push_back(parent);
+  scenario.mass.push_back(state[0]);
+  scenario.x.push_back(state[1]);
+  scenario.y.push_back(state[2]);
+  scenario.z.push_back(state[3]);
+  scenario.vx.push_back(state[4]);
+  scenario.vy.push_back(state[5]);
+  scenario.vz.push_back(state[6]);
+  scenario.sizes.push_back(look[0]);
+  scenario.colors.push_back(Color{look[1], look[2], look[3]});
+  scenario.spins.push_back(look[4]);
+}
+
+// Function to parse an entry of a scenario written as text, returning what
+// is wrong with it, if anything
+const char *parseScenarioEntry(char *&cursor, Scenario &scenario,
+                               std::unordered_map<std::string, int32_t> &ids) {
+  char *keyword = nextScenarioWord(cursor);
+  double state[7];
+  float look[5] = {1, 1, 1, 1, 0};
+
+  if (strcmp(keyword, "timestep") == 0) {
+    if (!readScenarioNumbers(cursor, state, 1) || state[0] <= 0) {
+      return "invalid timestep";
+    }
+    scenario.timestep = state[0];
+  } else if (strcmp(keyword, "horizon") == 0) {
+    if (!readScenarioNumbers(cursor, state, 1) || state[0] < 0) {
+      return "invalid horizon";
+    }
+    scenario.horizon = state[0];
+  } else if (strcmp(keyword, "body") == 0 || strcmp(keyword, "orbit") == 0) {
+    bool orbit = strcmp(keyword, "orbit") == 0;
+    char *name = nextScenarioWord(cursor);
+    char *parentName = nextScenarioWord(cursor);
+    if (parentName == nullptr || !readScenarioNumbers(cursor, state, 7) ||
+        (!endOfScenarioLine(cursor) &&
+         !readScenarioNumbers(cursor, look, 5))) {
+      return orbit ? "malformed orbit" : "malformed body";
+    }
+    bool named = strcmp(name, "-") != 0;
+    int32_t parent = -1;
+    if (strcmp(parentName, "-") != 0) {
+      auto found = ids.find(parentName);
+      if (found == ids.end()) {
+        return "unknown parent (parents must come first)";
+      }
+      parent = found->second;
+    }
+    if (state[0] < 0) {
+      return "negative mass";
+    }
+    if (look[0] < 0 || std::min({look[1], look[2], look[3]}) < 0 ||
+        std::max({look[1], look[2], look[3]}) > 1) {
+      return "invalid size or color";
+    }
+    if (named && ids.count(name) != 0) {
+      return "duplicate name";
+    }
+    if (named && scenario.count > ids.size()) {
+      return "named body after unnamed ones";
+    }
+
+    if (orbit) {
+      if (parent < 0) {
+        return "orbit without a parent";
+      }
+      if (!(state[1] > 0) || state[2] < 0 || state[2] >= 1) {
+        return "invalid semi-major axis or eccentricity";
+      }
+      const double radians = M_PI / 180;
+      OrbitalElements elements{state[1],           state[2],
+                               state[3] * radians, state[4] * radians,
+                               state[5] * radians, state[6] * radians};
+      double mu = gravitationalConstant * (scenario.mass[parent] + state[0]);
+      elementsToState(elements, mu, state + 1, state + 4);
+    }
+    if (parent >= 0) {
+      const std::vector<double> *parentState[6] = {
+          &scenario.x,  &scenario.y,  &scenario.z,
+          &scenario.vx, &scenario.vy, &scenario.vz};
+      for (int k = 0; k < 6; k++) {
+        state[k + 1] += (*parentState[k])[parent];
+      }
+    }
+    if (named) {
+      ids[name] = scenario.count;
+    }
+    pushScenarioBody(scenario, named ? name : "", parent, state, look);
+  } else if (strcmp(keyword, "ring") == 0) {
+    char *name = nextScenarioWord(cursor);
+    auto body = name != nullptr ? ids.find(name) : ids.end();
+    float radii[2];
+    double population[2] = {defaultRingParticles, defaultRingThickness};
+    if (body == ids.end()) {
+      return "ring around an unknown body";
+    }
+    if (!readScenarioNumbers(cursor, radii, 2) || radii[0] <= 0 ||
+        radii[1] <= radii[0]) {
+      return "invalid ring radii";
+    }
+    if (!endOfScenarioLine(cursor) &&
+        (!readScenarioNumbers(cursor, population, 2) || population[0] < 0 ||
+         population[0] > maxRingParticles ||
+         population[0] != std::floor(population[0]) || population[1] < 0)) {
+      return "invalid ring particles or thickness";
+    }
+    scenario.rings.push_back(ScenarioRing{body->second, radii[0], radii[1],
+                                          (uint32_t)population[0],
+                                          (float)population[1]});
+  } else {
+    return "unknown entry";
+  }
+  return nullptr;
+}
+
+// Function to parse a scenario written as text, one entry per line:
+//   timestep SECONDS
+//   horizon SECONDS
+//   body NAME PARENT MASS X Y Z VX VY VZ [SIZE R G B SPIN]
+//   orbit NAME PARENT MASS A E I NODE PERIAPSIS ANOMALY [SIZE R G B SPIN]
+//   ring NAME INNER OUTER [PARTICLES THICKNESS]
+// A name or a parent written "-" is left empty, and the state of a body is
+// relative to its parent, which must be named on an earlier line. An orbit
+// gives the state from the Keplerian elements around the parent (semi-major
+// axis, eccentricity, then the inclination, the longitude of the ascending
+// node, the argument of periapsis and the mean anomaly in degrees). Named
+// bodies must come before the unnamed ones. Files whose first line only
+// holds the timestep and the horizon, followed by lines of
+// "MASS X Z VX VZ", are read as unnamed bodies without parents in the XZ
+// plane
+bool parseScenarioText(char *text, const std::string &path,
+                       Scenario &scenario) {
+  scenario = Scenario();
+  std::unordered_map<std::string, int32_t> ids;
+  bool first = true, legacy = false;
+  char *line = text;
+  for (long number = 1; line != nullptr; number++) {
+    char *cursor = line;
+    line = strchr(line, '\n');
+    if (line != nullptr) {
+      *line++ = '\0';
+    }
+    if (endOfScenarioLine(cursor)) {
+      continue;
+    }
+
+    const char *problem = nullptr;
+    double state[7] = {0, 0, 0, 0, 0, 0, 0};
+    float look[5] = {1, 1, 1, 1, 0}; // size, color and spin
+    if (first && strchr("0123456789+-.", *cursor) != nullptr) {
+      legacy = true;
+      if (!readScenarioNumbers(cursor, state, 2) || state[0] <= 0 ||
+          state[1] < 0) {
+        problem = "invalid timestep or horizon";
+      }
+      scenario.timestep = state[0];
+      scenario.horizon = state[1];
+    } else if (legacy) {
+      look[0] = 0;
+      // The legacy bodies are in the XZ plane, so y and vy stay zero
+      double planar[5];
+      if (!readScenarioNumbers(cursor, planar, 5)) {
+        problem = "malformed body";
+      } else {
+        state[0] = planar[0];
+        state[1] = planar[1];
+        state[3] = planar[2];
+        state[4] = planar[3];
+        state[6] = planar[4];
+        pushScenarioBody(scenario, "", -1, state, look);
+      }
+    } else {
+      problem = parseScenarioEntry(cursor, scenario, ids);
+    }
+    first = false;
+
+    if (problem == nullptr && !endOfScenarioLine(cursor)) {
+      problem = "unexpected values at the end of the line";
+    }
+    if (problem != nullptr) {
+      std::cerr << "Line " << number << " of '" << path << "': " << problem
+                << "." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to lay out the compiled file of a scenario in memory
+void encodeScenario(Scenario &scenario, std::vector<char> &image) {
+  CompiledScenarioHeader header{};
+  memcpy(header.magic, compiledScenarioMagic, sizeof(header.magic));
+  header.version = compiledScenarioVersion;
+  header.byteOrder = compiledScenarioByteOrder;
+  header.headerSize = sizeof(CompiledScenarioHeader);
+  header.count = scenario.count;
+  header.ringCount = scenario.rings.size();
+  header.timestep = scenario.timestep;
+  header.horizon = scenario.horizon;
+
+  std::vector<ScenarioSection> sections = scenarioSectionsOf(scenario);
+  uint64_t offset = sizeof(CompiledScenarioHeader);
+  for (int i = 0; i < compiledScenarioSections; i++) {
+    header.offsets[i] = alignScenarioOffset(offset);
+    offset = header.offsets[i] + sections[i].bytes;
+  }
+  header.namesOffset = offset;
+  for (const std::string &name : scenario.names) {
+    header.namesSize += name.size() + 1;
+  }
+  header.fileSize = header.namesOffset + header.namesSize;
+
+  // The padding between the arrays is left zeroed
+  image.assign(header.fileSize, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  for (int i = 0; i < compiledScenarioSections; i++) {
+    memcpy(image.data() + header.offsets[i], sections[i].data,
+           sections[i].bytes);
+  }
+  char *name = image.data() + header.namesOffset;
+  for (const std::string &value : scenario.names) {
+    memcpy(name, value.c_str(), value.size() + 1);
+    name += value.size() + 1;
+  }
+}
+
+// Function to write the compiled form of a scenario, which loads without any
+// parsing
+bool saveCompiledScenario(const std::string &path, Scenario &scenario) {
+  std::vector<char> image;
+  encodeScenario(scenario, image);
+  FILE *file = fopen(path.c_str(), "wb");
+  bool written = file != nullptr &&
+                 fwrite(image.data(), 1, image.size(), file) == image.size();
+  if (file != nullptr) {
+    written = fclose(file) == 0 && written;
+  }
+  if (!written) {
+    std::cerr << "Could not write compiled scenario '" << path << "'."
+              << std::endl;
+  }
+  return written;
+}
+
+// Function to check that the relations between the bodies of a compiled
+// scenario are the ones its text form allows
+bool consistentScenario(const Scenario &scenario) {
+  bool unnamed = false;
+  for (size_t i = 0; i < scenario.count; i++) {
+    if (scenario.parents[i] < -1 || scenario.parents[i] >= (int32_t)i ||
+        (scenario.parents[i] >= 0 &&
+         scenario.names[scenario.parents[i]].empty()) ||
+        (unnamed && !scenario.names[i].empty())) {
+      return false;
+    }
+    unnamed = scenario.names[i].empty();
+  }
+  for (const ScenarioRing &ring : scenario.rings) {
+    if (ring.body < 0 || (size_t)ring.body >= scenario.count ||
+        scenario.names[ring.body].empty() ||
+        !(ring.inner > 0 && ring.outer > ring.inner) ||
+        ring.particles > maxRingParticles || !(ring.thickness >= 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Function to copy a compiled scenario from the content of its file
+bool decodeScenario(const char *data, size_t size, const std::string &path,
+                    Scenario &scenario) {
+  const CompiledScenarioHeader *header = (const CompiledScenarioHeader *)data;
+  const char *problem = nullptr;
+  if (size < sizeof(CompiledScenarioHeader)) {
+    problem = "is truncated";
+  } else if (header->version != compiledScenarioVersion) {
+    problem = "has an unsupported version";
+  } else if (header->byteOrder != compiledScenarioByteOrder) {
+    problem = "was compiled on a machine of another byte order";
+  } else if (header->headerSize != sizeof(CompiledScenarioHeader) ||
+             header->fileSize != size || header->namesOffset > size ||
+             header->namesOffset + header->namesSize != size ||
+             header->count > size || header->ringCount > size) {
+    problem = "is truncated or corrupted";
+  }
+
+  if (problem == nullptr) {
+    resizeScenario(scenario, header->count, header->ringCount);
+    std::vector<ScenarioSection> sections = scenarioSectionsOf(scenario);
+    uint64_t end = sizeof(CompiledScenarioHeader);
+    for (int i = 0; i < compiledScenarioSections && problem == nullptr; i++) {
+      if (header->offsets[i] < end ||
+          header->offsets[i] > header->namesOffset ||
+          header->offsets[i] + sections[i].bytes > header->namesOffset) {
+        problem = "is truncated or corrupted";
+      } else {
+        memcpy(sections[i].data, data + header->offsets[i], sections[i].bytes);
+        end = header->offsets[i] + sections[i].bytes;
+      }
+    }
+  }
+
+  if (problem == nullptr) {
+    const char *name = data + header->namesOffset;
+    const char *namesEnd = name + header->namesSize;
+    size_t i = 0;
+    while (name < namesEnd && i < scenario.count) {
+      const char *end = (const char *)memchr(name, '\0', namesEnd - name);
+      if (end == nullptr) {
+        break;
+      }
+      scenario.names[i++].assign(name, end);
+      name = end + 1;
+    }
+    scenario.timestep = header->timestep;
+    scenario.horizon = header->horizon;
+    if (i != scenario.count || name != namesEnd ||
+        !(scenario.timestep > 0 && scenario.horizon >= 0) ||
+        !consistentScenario(scenario)) {
+      problem = "is corrupted";
+    }
+  }
+
+  if (problem != nullptr) {
+    std::cerr << "The compiled scenario '" << path << "' " << problem << "."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Function to load a scenario file, written as text or compiled
+bool loadScenario(const std::string &path, Scenario &scenario) {
+  std::vector<char> content;
+  if (!readScenarioFile(path, content)) {
+    return false;
+  }
+  size_t size = content.size() - 1;
+  if (size >= sizeof(compiledScenarioMagic) &&
+      memcmp(content.data(), compiledScenarioMagic,
+             sizeof(compiledScenarioMagic)) == 0) {
+    return decodeScenario(content.data(), size, path, scenario);
+  }
+  return parseScenarioText(content.data(), path, scenario);
+}
+
+// Function to add the bodies of a scenario to a body system, in the order of
+// their IDs
+void addScenarioBodies(BodySystem &system, const Scenario &scenario) {
+  reserveBodies(system, system.count + scenario.count);
+  for (size_t i = 0; i < scenario.count; i++) {
+    addBody(system, scenario.names[i], scenario.mass[i], scenario.x[i],
+            scenario.y[i], scenario.z[i], scenario.vx[i], scenario.vy[i],
+            scenario.vz[i]);
+  }
+}
+
+#endif
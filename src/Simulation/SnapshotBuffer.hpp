@@ -0,0 +1,92 @@
+#ifndef SNAPSHOT_BUFFER_HPP
+#define SNAPSHOT_BUFFER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Define a structure holding the state of the bodies and the rings published
+// by the physics thread for the renderer
+struct Snapshot {
+  unsigned long sequence = 0; // 0 for slots never published
+  double time = 0;            // simulated time, in seconds
+  std::chrono::steady_clock::time_point publishedAt;
+  std::vector<double> x, y, z;
+  std::vector<uint32_t> ids; // only filled when bodies can be removed
+  std::vector<std::vector<int32_t>> rings; // particle positions of each ring
+};
+
+// Bit of the mailbox telling that its slot was published after the last
+// acquisition
+const int freshSnapshot = 4;
+const int snapshotSlotMask = 3;
+
+// Define a lock-free exchange of snapshots between one writer and one
+// reader. Of its four slots, the writer owns one, the reader owns two (the
+// latest and the previous snapshot, to interpolate between them), and the
+// remaining one waits in the mailbox. Slots are swapped through the mailbox,
+// so neither side ever waits for the other or allocates memory once the
+// slots have reached their size
+struct SnapshotBuffer {
+  Snapshot slots[4];
+  std::atomic<int> mailbox{2};
+  int writeSlot = 0;
+  int currentSlot = 1, previousSlot = 3;
+  unsigned long published = 0;
+};
+
+// Function to get the slot the writer fills next
+Snapshot &snapshotToWrite(SnapshotBuffer &buffer) {
+  return buffer.slots[buffer.writeSlot];
+}
+
+// Function to publish the slot filled by the writer, taking the one waiting
+// in the mailbox in exchange
+void publishSnapshot(SnapshotBuffer &buffer) {
+  Snapshot &snapshot = buffer.slots[buffer.writeSlot];
+  snapshot.sequence = ++buffer.published;
+  snapshot.publishedAt = std::chrono::steady_clock::now();
+
+  int previous = buffer.mailbox.exchange(buffer.writeSlot | freshSnapshot,
+                                         std::memory_order_acq_rel);
+  buffer.writeSlot = previous & snapshotSlotMask;
+}
+
+// Function to take the latest published snapshot, if there is a new one. The
+// reader gives its previous snapshot back in exchange
+bool acquireSnapshot(SnapshotBuffer &buffer) {
+  if (!(buffer.mailbox.load(std::memory_order_relaxed) & freshSnapshot)) {
+    return false;
+  }
+
+  int latest =
+      buffer.mailbox.exchange(buffer.previousSlot, std::memory_order_acq_rel);
+  buffer.previousSlot = buffer.currentSlot;
+  buffer.currentSlot = latest & snapshotSlotMask;
+  return true;
+}
+
+// Function to get the factor to interpolate from the previous to the current
+// snapshot at the given instant. Snapshots are shown one publication late,
+// so the motion stays smooth until the next one arrives
+double interpolationFactor(const SnapshotBuffer &buffer,
+                           std::chrono::steady_clock::time_point now) {
+  const Snapshot &current = buffer.slots[buffer.currentSlot];
+  const Snapshot &previous = buffer.slots[buffer.previousSlot];
+  if (previous.sequence == 0 || current.x.size() != previous.x.size()) {
+    return 1;
+  }
+
+  std::chrono::duration<double> interval =
+      current.publishedAt - previous.publishedAt;
+  std::chrono::duration<double> elapsed = now - current.publishedAt;
+  if (interval.count() <= 0) {
+    return 1;
+  }
+
+  double factor = elapsed.count() / interval.count();
+  return factor < 0 ? 0 : factor > 1 ? 1 : factor;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SPLINE_PATH_HPP
+#define SPLINE_PATH_HPP
+
+#include "../Structs/Coordinates.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Parameter steps of each curve segment used to measure its length
+const int splineSamplesPerSegment = 256;
+// Points of the table of a path, at equal distances along it
+const int splineTablePoints = 512;
+
+// Define a structure for a scripted path made of cubic Bezier segments, with
+// control points 3k to 3k + 3 for segment k. It is sampled once at equal
+// distances along the curve, so finding a point of the path is a table
+// lookup, and a body moving through the table at a steady rate moves at a
+// constant speed
+struct SplinePath {
+  std::vector<Coordinates> control;
+  std::vector<Coordinates> table;
+  double length = 0;
+  // Sphere around the control points, which contains the whole curve
+  Coordinates center{0, 0, 0};
+  GLfloat radius = 0;
+};
+
+// Function to sample a cubic Bezier segment at equal parameter steps by
+// forward differencing, which costs three additions per axis and point.
+// The start of the segment is not added, as it ends the previous one
+void sampleBezierSegment(const Coordinates *p, int steps,
+                         std::vector<Coordinates> &samples) {
+  double h = 1.0 / steps;
+  double f[3], df[3], d2f[3], d3f[3];
+  for (int axis = 0; axis < 3; axis++) {
+    auto at = [&](int i) {
+      return axis == 0 ? p[i].x : axis == 1 ? p[i].y : p[i].z;
+    };
+    // Coefficients of a t^3 + b t^2 + c t + d
+    double a = -at(0) + 3 * at(1) - 3 * at(2) + at(3);
+    double b = 3 * at(0) - 6 * at(1) + 3 * at(2);
+    double c = -3 * at(0) + 3 * at(1);
+    f[axis] = at(0);
+    df[axis] = a * h * h * h + b * h * h + c * h;
+    d2f[axis] = 6 * a * h * h * h + 2 * b * h * h;
+    d3f[axis] = 6 * a * h * h * h;
+  }
+
+  for (int step = 0; step < steps; step++) {
+    for (int axis = 0; axis < 3; axis++) {
+      f[axis] += df[axis];
+      df[axis] += d2f[axis];
+      d2f[axis] += d3f[axis];
+    }
+    samples.push_back({GLfloat(f[0]), GLfloat(f[1]), GLfloat(f[2])});
+  }
+  // Forward differencing drifts a little, so the segment ends exactly at
+  // its last control point
+  samples.back() = p[3];
+}
+
+// Function to build a path from its control points, which must be 3k + 1
+// for k segments
+bool buildSplinePath(SplinePath &path,
+                     const std::vector<Coordinates> &control) {
+  if (control.size() < 4 || (control.size() - 1) % 3 != 0) {
+    std::cerr << "A spline path needs 3k + 1 control points, not "
+              << control.size() << "." << std::endl;
+    return false;
+  }
+  path.control = control;
+
+  std::vector<Coordinates> samples = {control[0]};
+  for (size_t first = 0; first + 3 < control.size(); first += 3) {
+    sampleBezierSegment(&control[first], splineSamplesPerSegment, samples);
+  }
+  std::vector<double> distance(samples.size(), 0);
+  for (size_t i = 1; i < samples.size(); i++) {
+    double dx = samples[i].x - samples[i - 1].x;
+    double dy = samples[i].y - samples[i - 1].y;
+    double dz = samples[i].z - samples[i - 1].z;
+    distance[i] = distance[i - 1] + sqrt(dx * dx + dy * dy + dz * dz);
+  }
+  path.length = distance.back();
+
+  // Resample the curve at equal distances along it
+  path.table.resize(splineTablePoints);
+  size_t sample = 1;
+  for (int i = 0; i < splineTablePoints; i++) {
+    double wanted = path.length * i / (splineTablePoints - 1);
+    while (sample + 1 < samples.size() && distance[sample] < wanted) {
+      sample++;
+    }
+    double span = distance[sample] - distance[sample - 1];
+    GLfloat f = span > 0 ? (wanted - distance[sample - 1]) / span : 0;
+    f = std::min<GLfloat>(std::max<GLfloat>(f, 0), 1);
+    const Coordinates &a = samples[sample - 1], &b = samples[sample];
+    path.table[i] = {a.x + f * (b.x - a.x), a.y + f * (b.y - a.y),
+                     a.z + f * (b.z - a.z)};
+  }
+
+  path.center = {0, 0, 0};
+  for (const Coordinates &point : control) {
+    path.center.x += point.x / control.size();
+    path.center.y += point.y / control.size();
+    path.center.z += point.z / control.size();
+  }
+  path.radius = 0;
+  for (const Coordinates &point : control) {
+    GLfloat dx = point.x - path.center.x, dy = point.y - path.center.y,
+            dz = point.z - path.center.z;
+    path.radius =
+        std::max<GLfloat>(path.radius, sqrt(dx * dx + dy * dy + dz * dz));
+  }
+  return true;
+}
+
+// Function to get the point of a path at a fraction of its length, which
+// wraps around, so the path loops
+Coordinates splinePoint(const SplinePath &path, double fraction) {
+  fraction -= floor(fraction);
+  double position = fraction * (path.table.size() - 1);
+  size_t i = std::min<size_t>(position, path.table.size() - 2);
+  GLfloat f = position - i;
+  const Coordinates &a = path.table[i], &b = path.table[i + 1];
+  return {a.x + f * (b.x - a.x), a.y + f * (b.y - a.y), a.z + f * (b.z - a.z)};
+}
+
+#endif
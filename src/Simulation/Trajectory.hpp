@@ -0,0 +1,531 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include "../Physics/BodySystem.hpp"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const char trajectoryMagic[8] = {'S', 'O', 'L', 'A', 'R', 'T', 'R', 'J'};
+const char trajectoryIndexMagic[8] = {'T', 'R', 'J', 'I', 'N', 'D', 'E', 'X'};
+const uint32_t trajectoryVersion = 2;
+
+// Kinds of frame records
+enum TrajectoryFrameKind : uint8_t { TRAJECTORY_KEYFRAME, TRAJECTORY_DELTA };
+
+// Define the header at the start of a trajectory file, followed by the names
+// of the bodies, each one ended by a null character, and by the frames.
+//
+// Positions are stored as integer multiples of the quantum, P, together with
+// their change since the previous frame, V. A keyframe holds P and V of
+// every body as raw 64-bit integers (Px, Py, Pz, Vx, Vy, Vz), and the other
+// frames only hold the change of V as zigzag varints (dVx, dVy, dVz), which
+// are small since the bodies move smoothly. The first frame and every
+// keyframeInterval-th frame after it are keyframes, and a frame is decoded
+// from the keyframe before it. As integers are exact, a frame can also be
+// decoded backwards from the next one, and the rounding error of a position
+// never exceeds half the quantum, whatever the number of frames
+struct TrajectoryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t keyframeInterval;
+  uint64_t count;
+  double quantum; // in meters
+  uint64_t namesSize;
+};
+
+// Define the header of a frame record, followed by payloadSize bytes
+struct TrajectoryFrameHeader {
+  uint8_t kind;
+  uint8_t padding[3];
+  uint32_t payloadSize;
+  double time; // simulated time, in seconds
+};
+
+// Define an entry of the keyframe index. Keyframe k is frame
+// k * keyframeInterval, so finding the keyframe of a frame takes a division
+struct TrajectoryKeyframe {
+  uint64_t frame;
+  uint64_t offset; // of its record, in bytes from the start of the file
+  double time;
+};
+
+// Define the trailer at the end of a finished trajectory file, after the
+// keyframe index
+struct TrajectoryTrailer {
+  uint64_t indexOffset;
+  uint64_t keyframes;
+  uint64_t frames;
+  char magic[8];
+};
+
+// Define a frame given to the recorder, waiting to be encoded
+struct TrajectoryPendingFrame {
+  double time = 0;
+  std::vector<double> x, y, z;
+};
+
+// Define a recorder streaming the positions of the bodies to a trajectory
+// file. The simulation only copies the positions into a free slot, and a
+// writer thread encodes and writes them
+struct TrajectoryRecorder {
+  std::string path;
+  FILE *file = nullptr;
+  size_t count = 0;
+  uint32_t keyframeInterval = 32;
+  double quantum = 1000;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<TrajectoryPendingFrame> slots;
+  std::vector<int> freeSlots;
+  std::deque<int> filledSlots;
+  bool encoding = false; // whether the writer holds a frame
+  bool stopping = false;
+  bool failed = false;
+  // State of the encoder, only used by the writer thread
+  std::vector<int64_t> px, py, pz, vx, vy, vz;
+  std::vector<uint8_t> buffer;
+  // Frames on disk, published under the mutex for the readers
+  uint64_t frames = 0;
+  uint64_t written = 0; // bytes
+  std::vector<TrajectoryKeyframe> index;
+};
+
+// Define a reader of the frames of a trajectory file, which keeps the group
+// of frames between two keyframes in memory and moves through it in both
+// directions
+struct TrajectoryReader {
+  FILE *file = nullptr;
+  size_t count = 0;
+  uint32_t keyframeInterval = 1;
+  double quantum = 1;
+  uint64_t frames = 0;
+  uint64_t end = 0; // bytes
+  std::vector<TrajectoryKeyframe> index;
+  long group = -1; // keyframe whose frames are loaded
+  std::vector<uint8_t> groupBytes;
+  std::vector<size_t> recordOffsets;
+  std::vector<double> recordTimes;
+  uint64_t frame = 0; // frame whose positions are decoded
+  std::vector<int64_t> px, py, pz, vx, vy, vz;
+};
+
+// Function to write a signed integer as a zigzag varint, returning the byte
+// after it. At most 10 bytes are written
+uint8_t *putVarint(uint8_t *out, int64_t value) {
+  uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  while (zigzag >= 0x80) {
+    *out++ = uint8_t(zigzag) | 0x80;
+    zigzag >>= 7;
+  }
+  *out++ = uint8_t(zigzag);
+  return out;
+}
+
+// Function to read a zigzag varint, returning the byte after it, or nullptr
+// if it does not end before the given end
+const uint8_t *getVarint(const uint8_t *in, const uint8_t *end,
+                         int64_t &value) {
+  uint64_t zigzag = 0;
+  for (int shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t byte = *in++;
+    zigzag |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      value = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+      return in;
+    }
+  }
+  return nullptr;
+}
+
+// Function to encode a frame into the buffer of the recorder, as a keyframe
+// or as a change from the previous frame
+void encodeTrajectoryFrame(TrajectoryRecorder &recorder,
+                           const TrajectoryPendingFrame &pending,
+                           bool keyframe) {
+  size_t count = recorder.count;
+  size_t payloadMax = keyframe ? count * 6 * sizeof(int64_t) : count * 3 * 10;
+  recorder.buffer.resize(sizeof(TrajectoryFrameHeader) + payloadMax);
+  uint8_t *payload = recorder.buffer.data() + sizeof(TrajectoryFrameHeader);
+  uint8_t *out = payload;
+
+  bool first = recorder.frames == 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t px = llround(pending.x[i] / recorder.quantum);
+    int64_t py = llround(pending.y[i] / recorder.quantum);
+    int64_t pz = llround(pending.z[i] / recorder.quantum);
+    int64_t vx = first ? 0 : px - recorder.px[i];
+    int64_t vy = first ? 0 : py - recorder.py[i];
+    int64_t vz = first ? 0 : pz - recorder.pz[i];
+    if (keyframe) {
+      int64_t values[6] = {px, py, pz, vx, vy, vz};
+      memcpy(out, values, sizeof(values));
+      out += sizeof(values);
+    } else {
+      out = putVarint(out, vx - recorder.vx[i]);
+      out = putVarint(out, vy - recorder.vy[i]);
+      out = putVarint(out, vz - recorder.vz[i]);
+    }
+    recorder.px[i] = px;
+    recorder.py[i] = py;
+    recorder.pz[i] = pz;
+    recorder.vx[i] = vx;
+    recorder.vy[i] = vy;
+    recorder.vz[i] = vz;
+  }
+
+  TrajectoryFrameHeader header{};
+  header.kind = keyframe ? TRAJECTORY_KEYFRAME : TRAJECTORY_DELTA;
+  header.payloadSize = out - payload;
+  header.time = pending.time;
+  memcpy(recorder.buffer.data(), &header, sizeof(header));
+  recorder.buffer.resize(out - recorder.buffer.data());
+}
+
+// Main loop of the writer thread, which encodes the frames in the order they
+// were recorded and flushes each one, so readers can seek to it at once
+void trajectoryWriterLoop(TrajectoryRecorder &recorder) {
+  std::unique_lock<std::mutex> lock(recorder.mutex);
+  while (true) {
+    recorder.changed.wait(lock, [&] {
+      return recorder.stopping || !recorder.filledSlots.empty();
+    });
+    if (recorder.filledSlots.empty()) {
+      return;
+    }
+    int slot = recorder.filledSlots.front();
+    recorder.filledSlots.pop_front();
+    recorder.encoding = true;
+    uint64_t frame = recorder.frames;
+    lock.unlock();
+
+    const TrajectoryPendingFrame &pending = recorder.slots[slot];
+    bool keyframe = frame % recorder.keyframeInterval == 0;
+    encodeTrajectoryFrame(recorder, pending, keyframe);
+    bool written = !recorder.failed &&
+                   fwrite(recorder.buffer.data(), 1, recorder.buffer.size(),
+                          recorder.file) == recorder.buffer.size() &&
+                   fflush(recorder.file) == 0;
+
+    lock.lock();
+    if (!written && !recorder.failed) {
+      std::cerr << "Could not write trajectory file '" << recorder.path
+                << "'." << std::endl;
+      recorder.failed = true;
+    }
+    if (written) {
+      if (keyframe) {
+        recorder.index.push_back({frame, recorder.written, pending.time});
+      }
+      recorder.written += recorder.buffer.size();
+      recorder.frames++;
+    }
+    recorder.encoding = false;
+    recorder.freeSlots.push_back(slot);
+    recorder.changed.notify_all();
+  }
+}
+
+// Function to create a trajectory file for the bodies of a system and start
+// its writer thread. Positions are rounded to multiples of quantum meters
+bool startTrajectoryRecorder(TrajectoryRecorder &recorder,
+                             const std::string &path,
+                             const BodySystem &system, double quantum,
+                             int slotCount) {
+  recorder.path = path;
+  recorder.count = system.count;
+  recorder.quantum = quantum;
+  recorder.file = fopen(path.c_str(), "wb");
+  if (recorder.file == nullptr) {
+    std::cerr << "Could not create trajectory file '" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  TrajectoryHeader header{};
+  memcpy(header.magic, trajectoryMagic, sizeof(header.magic));
+  header.version = trajectoryVersion;
+  header.keyframeInterval = recorder.keyframeInterval;
+  header.count = system.count;
+  header.quantum = quantum;
+  for (const std::string &name : system.names) {
+    header.namesSize += name.size() + 1;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, recorder.file) == 1;
+  for (const std::string &name : system.names) {
+    written = written &&
+              fwrite(name.c_str(), name.size() + 1, 1, recorder.file) == 1;
+  }
+  if (!written) {
+    std::cerr << "Could not write trajectory file '" << path << "'."
+              << std::endl;
+    fclose(recorder.file);
+    recorder.file = nullptr;
+    return false;
+  }
+  recorder.written = sizeof(header) + header.namesSize;
+
+  for (std::vector<int64_t> *state :
+       {&recorder.px, &recorder.py, &recorder.pz, &recorder.vx, &recorder.vy,
+        &recorder.vz}) {
+    state->assign(system.count, 0);
+  }
+  recorder.slots.assign(slotCount, TrajectoryPendingFrame());
+  recorder.freeSlots.clear();
+  for (int slot = 0; slot < slotCount; slot++) {
+    recorder.slots[slot].x.reserve(system.count);
+    recorder.slots[slot].y.reserve(system.count);
+    recorder.slots[slot].z.reserve(system.count);
+    recorder.freeSlots.push_back(slot);
+  }
+  recorder.thread = std::thread(trajectoryWriterLoop, std::ref(recorder));
+  return true;
+}
+
+// Function to queue the positions of the bodies for recording. It only waits
+// if the writer has fallen behind by every slot
+void recordTrajectoryFrame(TrajectoryRecorder &recorder,
+                           const BodySystem &system, double time) {
+  int slot;
+  {
+    std::unique_lock<std::mutex> lock(recorder.mutex);
+    recorder.changed.wait(lock, [&] { return !recorder.freeSlots.empty(); });
+    slot = recorder.freeSlots.back();
+    recorder.freeSlots.pop_back();
+  }
+
+  TrajectoryPendingFrame &pending = recorder.slots[slot];
+  pending.time = time;
+  pending.x.assign(system.x.begin(), system.x.begin() + recorder.count);
+  pending.y.assign(system.y.begin(), system.y.begin() + recorder.count);
+  pending.z.assign(system.z.begin(), system.z.begin() + recorder.count);
+
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  recorder.filledSlots.push_back(slot);
+  recorder.changed.notify_all();
+}
+
+// Function to wait until every recorded frame is on disk
+void waitForTrajectoryWriter(TrajectoryRecorder &recorder) {
+  std::unique_lock<std::mutex> lock(recorder.mutex);
+  recorder.changed.wait(lock, [&] {
+    return recorder.filledSlots.empty() && !recorder.encoding;
+  });
+}
+
+// Function to write the queued frames and the keyframe index, and close the
+// file. Returns false if any frame could not be written
+bool stopTrajectoryRecorder(TrajectoryRecorder &recorder) {
+  if (recorder.file == nullptr) {
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    recorder.stopping = true;
+  }
+  recorder.changed.notify_all();
+  if (recorder.thread.joinable()) {
+    recorder.thread.join();
+  }
+
+  TrajectoryTrailer trailer{};
+  trailer.indexOffset = recorder.written;
+  trailer.keyframes = recorder.index.size();
+  trailer.frames = recorder.frames;
+  memcpy(trailer.magic, trajectoryIndexMagic, sizeof(trailer.magic));
+  bool written = !recorder.failed &&
+                 fwrite(recorder.index.data(), sizeof(TrajectoryKeyframe),
+                        recorder.index.size(),
+                        recorder.file) == recorder.index.size() &&
+                 fwrite(&trailer, sizeof(trailer), 1, recorder.file) == 1;
+  written = fclose(recorder.file) == 0 && written;
+  recorder.file = nullptr;
+  if (!written && !recorder.failed) {
+    std::cerr << "Could not write trajectory file '" << recorder.path << "'."
+              << std::endl;
+  }
+  return written;
+}
+
+// Function to close the file of a reader
+void closeTrajectoryReader(TrajectoryReader &reader) {
+  if (reader.file != nullptr) {
+    fclose(reader.file);
+  }
+  reader = TrajectoryReader();
+}
+
+// Function to open a reader on the frames a recorder has written so far
+bool openTrajectoryReader(TrajectoryReader &reader,
+                          TrajectoryRecorder &recorder) {
+  closeTrajectoryReader(reader);
+  {
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    if (recorder.failed || recorder.frames == 0) {
+      return false;
+    }
+    reader.index = recorder.index;
+    reader.frames = recorder.frames;
+    reader.end = recorder.written;
+  }
+  reader.count = recorder.count;
+  reader.keyframeInterval = recorder.keyframeInterval;
+  reader.quantum = recorder.quantum;
+  reader.file = fopen(recorder.path.c_str(), "rb");
+  if (reader.file == nullptr) {
+    std::cerr << "Could not open trajectory file '" << recorder.path << "'."
+              << std::endl;
+    return false;
+  }
+  for (std::vector<int64_t> *state : {&reader.px, &reader.py, &reader.pz,
+                                      &reader.vx, &reader.vy, &reader.vz}) {
+    state->assign(reader.count, 0);
+  }
+  return true;
+}
+
+// Function to read the frames of a group into memory and decode its keyframe
+bool loadTrajectoryGroup(TrajectoryReader &reader, long group) {
+  uint64_t begin = reader.index[group].offset;
+  uint64_t end = (size_t)group + 1 < reader.index.size()
+                     ? reader.index[group + 1].offset
+                     : reader.end;
+  reader.group = -1;
+  reader.groupBytes.resize(end - begin);
+  if (fseek(reader.file, begin, SEEK_SET) != 0 ||
+      fread(reader.groupBytes.data(), 1, end - begin, reader.file) !=
+          end - begin) {
+    std::cerr << "Could not read the trajectory file." << std::endl;
+    return false;
+  }
+
+  reader.recordOffsets.clear();
+  reader.recordTimes.clear();
+  for (size_t offset = 0; offset + sizeof(TrajectoryFrameHeader) <=
+                          reader.groupBytes.size();) {
+    TrajectoryFrameHeader header;
+    memcpy(&header, reader.groupBytes.data() + offset, sizeof(header));
+    reader.recordOffsets.push_back(offset);
+    reader.recordTimes.push_back(header.time);
+    offset += sizeof(header) + header.payloadSize;
+  }
+
+  TrajectoryFrameHeader keyframe{};
+  if (!reader.groupBytes.empty()) {
+    memcpy(&keyframe, reader.groupBytes.data(), sizeof(keyframe));
+  }
+  if (reader.recordOffsets.empty() || keyframe.kind != TRAJECTORY_KEYFRAME ||
+      keyframe.payloadSize != reader.count * 6 * sizeof(int64_t)) {
+    std::cerr << "The trajectory file is corrupted." << std::endl;
+    return false;
+  }
+  const uint8_t *payload = reader.groupBytes.data() +
+                           sizeof(TrajectoryFrameHeader);
+  for (size_t i = 0; i < reader.count; i++) {
+    int64_t values[6];
+    memcpy(values, payload + i * sizeof(values), sizeof(values));
+    reader.px[i] = values[0];
+    reader.py[i] = values[1];
+    reader.pz[i] = values[2];
+    reader.vx[i] = values[3];
+    reader.vy[i] = values[4];
+    reader.vz[i] = values[5];
+  }
+  reader.group = group;
+  reader.frame = reader.index[group].frame;
+  return true;
+}
+
+// Function to apply the changes of a delta record to the decoded positions,
+// forwards (way 1, to the frame of the record) or backwards (way -1, from
+// the frame of the record to the previous one)
+void applyTrajectoryDelta(TrajectoryReader &reader, size_t record, int way) {
+  const uint8_t *in = reader.groupBytes.data() + reader.recordOffsets[record] +
+                      sizeof(TrajectoryFrameHeader);
+  const uint8_t *end = reader.groupBytes.data() + reader.groupBytes.size();
+  for (size_t i = 0; i < reader.count && in != nullptr; i++) {
+    int64_t dx = 0, dy = 0, dz = 0;
+    in = getVarint(in, end, dx);
+    if (in != nullptr) {
+      in = getVarint(in, end, dy);
+    }
+    if (in != nullptr) {
+      in = getVarint(in, end, dz);
+    }
+    if (way > 0) {
+      reader.vx[i] += dx;
+      reader.vy[i] += dy;
+      reader.vz[i] += dz;
+      reader.px[i] += reader.vx[i];
+      reader.py[i] += reader.vy[i];
+      reader.pz[i] += reader.vz[i];
+    } else {
+      reader.px[i] -= reader.vx[i];
+      reader.py[i] -= reader.vy[i];
+      reader.pz[i] -= reader.vz[i];
+      reader.vx[i] -= dx;
+      reader.vy[i] -= dy;
+      reader.vz[i] -= dz;
+    }
+  }
+}
+
+// Function to decode a frame. The group of the frame is found with a
+// division, and the frame is reached from the current one if it is in the
+// same group, or from the keyframe of its group otherwise
+bool seekTrajectoryFrame(TrajectoryReader &reader, uint64_t frame) {
+  frame = std::min(frame, reader.frames - 1);
+  long group = frame / reader.keyframeInterval;
+  if (group != reader.group && !loadTrajectoryGroup(reader, group)) {
+    return false;
+  }
+
+  uint64_t first = reader.index[group].frame;
+  if (frame - first >= reader.recordOffsets.size()) {
+    return false;
+  }
+  while (reader.frame < frame) {
+    reader.frame++;
+    applyTrajectoryDelta(reader, reader.frame - first, 1);
+  }
+  while (reader.frame > frame) {
+    applyTrajectoryDelta(reader, reader.frame - first, -1);
+    reader.frame--;
+  }
+  return true;
+}
+
+// Function to decode the last frame recorded at or before a time, or the
+// first frame if the time is before all of them
+bool seekTrajectoryTime(TrajectoryReader &reader, double time) {
+  auto after = std::upper_bound(
+      reader.index.begin(), reader.index.end(), time,
+      [](double t, const TrajectoryKeyframe &key) { return t < key.time; });
+  long group = std::max<long>(after - reader.index.begin() - 1, 0);
+  if (group != reader.group && !loadTrajectoryGroup(reader, group)) {
+    return false;
+  }
+
+  size_t record = std::upper_bound(reader.recordTimes.begin(),
+                                   reader.recordTimes.end(), time) -
+                  reader.recordTimes.begin();
+  return seekTrajectoryFrame(reader, reader.index[group].frame +
+                                         (record > 0 ? record - 1 : 0));
+}
+
+// Function to get the time of the decoded frame
+double trajectoryTime(const TrajectoryReader &reader) {
+  return reader.recordTimes[reader.frame - reader.index[reader.group].frame];
+}
+
+#endif
@@ -6,14 +6,15 @@
 
 // Define a structure for representing celestial bodies
 struct Body {
-  GLfloat mass;
-  GLfloat x, z;
-  GLfloat vx, vz;
+  GLdouble mass;
+  GLdouble x, y, z;
+  GLdouble vx, vy, vz;
   GLfloat velocity;
   GLfloat rotatedAngle;
   GLfloat ownAxisRotationVelocity;
   Color color;
   GLfloat simulatedSize;
+  int systemIndex; // index in the body system, or -1 if not integrated
 };
 
 #endif
@@ -1,19 +1,53 @@
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+#include "Parallel/ThreadPool.hpp"
 #include "Structs/Body.hpp"
 #include "Structs/Coordinates.hpp"
-#include "Structs/Star.hpp"
+#include "Physics/BodySystem.hpp"
+#include "Physics/Gravity.hpp"
+#include "Physics/GravitySolver.hpp"
+#include "Physics/Integrators.hpp"
+#include "Physics/RingParticles.hpp"
+#include "Profiling/Benchmark.hpp"
+#include "Profiling/Profiler.hpp"
+#include "Render/BodyBatch.hpp"
+#include "Render/CameraPath.hpp"
+#include "Render/DrawnLifts.hpp"
+#include "Render/FrameWriter.hpp"
+#include "Render/Frustum.hpp"
+#include "Render/GridMesh.hpp"
+#include "Render/OffscreenContext.hpp"
+#include "Render/OrbitTrails.hpp"
+#include "Render/PathMesh.hpp"
+#include "Render/PixelReadback.hpp"
+#include "Render/ProfilerHud.hpp"
+#include "Render/RingBatch.hpp"
+#include "Render/SphereMesh.hpp"
+#include "Render/StarCatalogue.hpp"
+#include "Render/StarField.hpp"
+#include "Simulation/AsteroidBelt.hpp"
+#include "Simulation/Checkpoint.hpp"
+#include "Simulation/Ensemble.hpp"
+#include "Simulation/Options.hpp"
+#include "Simulation/Scenario.hpp"
+#include "Simulation/SnapshotBuffer.hpp"
+#include "Simulation/SplinePath.hpp"
+#include "Simulation/Trajectory.hpp"
 
 #define POSITIVE 1
 #define NEGATIVE -1
 #define PI 3.14159265358
-#define G 6.67430e-11
 
 using namespace std;
 
@@ -31,29 +65,66 @@ const int minCamSpeed = 1;
 const int maxCamSpeed = 200;
 const GLfloat mouseSensitivity = 0.05;
 const int gridSize = 1e5;
-const int numberOfStars = 1e5;
+const int frameWriterSlots = 4;
+const size_t directSumBenchmarkLimit = 1e5; // larger systems take too long
+const size_t pathBenchmarkPoints = 1e5;
+const long benchmarkAsteroids = 1e4; // drawn when --asteroids is not given
+const string defaultCheckpointPath = "checkpoint.bin";
+const int trajectorySlots = 8;
+const string defaultScenarioPath = "Data/solar-system.txt";
+const string defaultHeadlessScenarioPath = "Data/data.txt";
+const size_t finderKeys = 8;
+const size_t ringMoons = 4; // heaviest moons pulling on each ring
 
 // Define objects representing celestial bodies and camera settings
-Body sun, moon, comet;
-map<string, Body> planets;
-Star stars[numberOfStars];
-GLdouble Px, Py, Pz;
+Body comet;
+Scenario scenario;
+vector<Body> heroBodies; // named bodies of the scenario, by ID
+BodySystem bodySystem;
+GravitySolver gravitySolver;
+Integrator integrator;
+ThreadPool threadPool;
+Options options;
+SnapshotBuffer snapshots;
+thread physicsThread;
+atomic<bool> physicsRunning{false};
+atomic<bool> checkpointRequested{false};
+CheckpointWriter checkpointWriter;
+TrajectoryRecorder recorder;
+TrajectoryReader replay;
+bool replaying = false; // whether the physics thread replays the recording
+double replayTime = 0;
+vector<StarVertex> stars;
+StarField starField;
+SphereMesh sphereMesh;
+BodyBatch smallBodies;
+size_t heroBodyCount = 0; // bodies drawn one by one, the rest are batched
+vector<RingParticles> rings; // particles of the rings of the scenario
+vector<RingBatch> ringBatches;
+Frustum frustum;
+GridMesh gridMesh;
+OrbitTrails orbitTrails;
+DrawnLifts drawnLifts; // named bodies drawn clear of their parents
+CullingStats cullingStats; // objects drawn and culled in the last frame
 GLfloat fov = 60, fAspect, width = 1200, height = 900, cameraYaw = -90,
         cameraPitch = 0;
 Coordinates camera{0, 500, 300}, lookAtHim{camera.x, camera.y, camera.z - 1};
 int camSpeed = 10;
 int previousMouseX, previousMouseY;
-int simulationSpeed = 25;
-bool simulationPaused = false;
-int Bx[] = {-5000, -1000, 1000, 5000};
-int By[] = {0, 0, 0, 0};
-int Bz[] = {20000, -8000, -8000, 20000};
-bool findPlanet[] = {false, false, false, false, false, false, false, false};
-string planetsNames[] = {"Mercury", "Venus",  "Earth",  "Mars",
-                         "Jupiter", "Saturn", "Uranus", "Neptune"};
-double currentCometPosition = 0;
+// Shared with the physics thread
+atomic<int> simulationSpeed{25};
+atomic<bool> simulationPaused{false};
+// Control points of the comet orbit, in scene units
+const vector<Coordinates> cometPathControl = {
+    {-5000, 0, 20000}, {-1000, 0, -8000}, {1000, 0, -8000}, {5000, 0, 20000}};
+SplinePath cometPath;
+PathMesh cometPathMesh;
+vector<int> finderBodies; // IDs of the bodies found with the keys 1 to 8
+bool findPlanet[finderKeys] = {};
 bool showBezierCurve = true;
 bool showGrid = true;
+bool showTrails = true;
+bool showProfilerHud = false;
 int gridSpacing = 2e2;
 int nextYLimitDelta = 1000;
 int nextYLimit = nextYLimitDelta;
@@ -66,68 +137,85 @@ void logCoordinates(Coordinates coordinates) {
   cout << "z: " << coordinates.z << endl;
 }
 
-// Function to calculate Bezier point coordinates
-float calculateBezierPoint(char c, double t) {
-  switch (c) {
-  case 'x':
-    return (pow(1 - t, 3) * Bx[0] + 3 * t * pow(1 - t, 2) * Bx[1] +
-            3 * pow(t, 2) * (1 - t) * Bx[2] + pow(t, 3) * Bx[3]);
-  case 'y':
-    return (pow(1 - t, 3) * By[0] + 3 * t * pow(1 - t, 2) * By[1] +
-            3 * pow(t, 2) * (1 - t) * By[2] + pow(t, 3) * By[3]);
-  case 'z':
-    return (pow(1 - t, 3) * Bz[0] + 3 * t * pow(1 - t, 2) * Bz[1] +
-            3 * pow(t, 2) * (1 - t) * Bz[2] + pow(t, 3) * Bz[3]);
-  default:
-    // Print an error message and exit the program
-    std::cerr << "Invalid character '" << c
-              << "' passed to calculateBezierPoint." << std::endl;
-    exit(EXIT_FAILURE);
-  }
-}
-
-// Function to calculate gravitational force between two bodies
-void calculateGravity(Body &body1, Body &body2, GLfloat &ax, GLfloat &az) {
-  GLfloat dx = body2.x - body1.x;
-  GLfloat dz = body2.z - body1.z;
-  GLfloat r = sqrt(dx * dx + dz * dz);
-
-  GLfloat F = (G * body1.mass * body2.mass) / (r * r);
-
-  ax += (F * (dx / r)) / body1.mass;
-  az += (F * (dz / r)) / body1.mass;
+// Function to update the rotation of a body to a given simulated time. The
+// rotation velocity is given in degrees per simulationTimePrecision seconds
+void rotateBody(Body &body, double time) {
+  body.rotatedAngle =
+      fmod(body.ownAxisRotationVelocity * time / simulationTimePrecision, 360);
 }
 
-// Function to update the rotation of a body
-void rotateBody(Body &body, int timeWay) {
-  body.rotatedAngle += timeWay * body.ownAxisRotationVelocity;
+// Function to update comet's position to a given simulated time. Its
+// velocity is the fraction of the length of its path run in
+// simulationTimePrecision seconds, so it moves at a constant speed
+void updateComet(Body &body, double time) {
+  Coordinates position =
+      splinePoint(cometPath, body.velocity * time / simulationTimePrecision);
+  body.x = position.x / scale;
+  body.y = position.y / scale;
+  body.z = position.z / scale;
 }
 
-// Function to update the position, velocity, and rotation of a body
-void updateBody(Body &body, GLfloat ax, GLfloat az, int timeWay, int dt) {
-  dt *= timeWay;
-
-  body.vx += ax * dt;
-  body.vz += az * dt;
-
-  body.x += body.vx * dt;
-  body.z += body.vz * dt;
+// Function to place an integrated body between two snapshots
+void interpolateBody(Body &body, const Snapshot &previous,
+                     const Snapshot &current, double factor) {
+  size_t i = body.systemIndex;
+  if (body.systemIndex < 0 || i >= current.x.size()) {
+    return;
+  }
 
-  rotateBody(body, timeWay);
+  if (factor < 1) {
+    body.x = previous.x[i] + factor * (current.x[i] - previous.x[i]);
+    body.y = previous.y[i] + factor * (current.y[i] - previous.y[i]);
+    body.z = previous.z[i] + factor * (current.z[i] - previous.z[i]);
+  } else {
+    body.x = current.x[i];
+    body.y = current.y[i];
+    body.z = current.z[i];
+  }
 }
 
-// Function to update comet's position
-void updateComet(Body &body, int timeWay) {
-  currentCometPosition += timeWay * body.velocity;
+// Function to move a named body to where it is drawn, clear of its parent
+void liftBody(Body &body) {
+  if (body.systemIndex < 0) {
+    return;
+  }
+  double x = body.x * scale, y = body.y * scale, z = body.z * scale;
+  liftPosition(drawnLifts, body.systemIndex, x, y, z);
+  body.x = x / scale;
+  body.y = y / scale;
+  body.z = z / scale;
+}
 
-  if (currentCometPosition > 1) {
-    currentCometPosition = 0;
-  } else if (currentCometPosition < 0) {
-    currentCometPosition = 1;
+// Function to update the rendered bodies from the snapshots published by the
+// physics thread, interpolating between the two latest ones
+void updateRenderedBodies() {
+  acquireSnapshot(snapshots);
+  const Snapshot &current = snapshots.slots[snapshots.currentSlot];
+  const Snapshot &previous = snapshots.slots[snapshots.previousSlot];
+  if (current.sequence == 0) {
+    return;
+  }
+  pushTrailSample(orbitTrails, current, scale, drawnLifts);
+
+  // Offscreen frames are rendered right after their physics step
+  double factor =
+      options.offscreen
+          ? 1
+          : interpolationFactor(snapshots, chrono::steady_clock::now());
+  double time =
+      factor < 1 ? previous.time + factor * (current.time - previous.time)
+                 : current.time;
+
+  for (Body &body : heroBodies) {
+    rotateBody(body, time);
+    interpolateBody(body, previous, current, factor);
+  }
+  updateComet(comet, time);
+  for (Body &body : heroBodies) {
+    liftBody(body);
   }
 
-  body.x = calculateBezierPoint('x', currentCometPosition) / scale;
-  body.z = calculateBezierPoint('z', currentCometPosition) / scale;
+  fillBodyBatch(smallBodies, previous, current, factor, heroBodyCount, scale);
 }
 
 // Function to draw a crosshair at the center of the screen
@@ -138,131 +226,136 @@ void drawCrosshair() {
   glEnd();
 }
 
-// Function to draw a celestial body
+// Function to estimate the radius, in pixels, a sphere covers on the screen
+GLfloat projectedRadius(GLdouble x, GLdouble y, GLdouble z, GLfloat radius) {
+  GLdouble dx = x - camera.x, dy = y - camera.y, dz = z - camera.z;
+  GLdouble distance = sqrt(dx * dx + dy * dy + dz * dz);
+  if (distance <= radius) {
+    return height;
+  }
+  return radius / (distance * tan(fov * PI / 360)) * height / 2;
+}
+
+// Function to draw a celestial body, with a sphere as detailed as its size
+// on the screen requires
 void drawBody(Body body) {
+  GLdouble x = body.x * scale, y = body.y * scale, z = body.z * scale;
+  if (!cullSphere(frustum, cullingStats, x, y, z, body.simulatedSize)) {
+    return;
+  }
+  int level = sphereLevelFor(projectedRadius(x, y, z, body.simulatedSize));
+
   glColor3f(body.color.r, body.color.g, body.color.b);
   glPushMatrix();
-  glTranslated(body.x * scale, 0, body.z * scale);
+  glTranslated(x, y, z);
   glRotatef(body.rotatedAngle, 0.0, 1.0, 0.0);
-  glutSolidSphere(body.simulatedSize, 80, 20);
+  glScalef(body.simulatedSize, body.simulatedSize, body.simulatedSize);
+  drawSphere(sphereMesh, level);
   glPopMatrix();
 }
 
-// Function to draw a ring
-void drawRing(Body planet, GLfloat innerRadius, GLfloat outerRadius,
-              int sides) {
-  glBegin(GL_TRIANGLE_STRIP);
-  glLineWidth(4.0f);
-  glColor3f(planet.color.r, planet.color.g, planet.color.b);
-  for (int i = 0; i <= sides; ++i) {
-    GLfloat angle = 2.0f * M_PI * i / sides;
-    GLfloat x = cos(angle);
-    GLfloat z = sin(angle);
-
-    // Outer vertex
-    glVertex3f((planet.x * scale + outerRadius * x), 0,
-               (planet.z * scale + outerRadius * z));
-
-    // Inner vertex
-    glVertex3f((planet.x * scale + innerRadius * x), 0,
-               (planet.z * scale + innerRadius * z));
+// Function to draw the named bodies of the scenario
+void drawHeroBodies() {
+  for (const Body &body : heroBodies) {
+    drawBody(body);
   }
-  glEnd();
 }
 
-// Function do draw all the planets
-void drawPlanets() {
-  for (auto &x : planets) {
-    drawBody(x.second);
-
-    if (x.first == "Saturn") {
-      drawRing(x.second, 1.2 * x.second.simulatedSize,
-               1.5 * x.second.simulatedSize, 50);
+// Function to draw the particles of the rings, in the colors of their bodies.
+// The particles are drawn as sprites when the nearest ones are large enough
+// on the screen for their shape to show
+void drawRings() {
+  const Snapshot &current = snapshots.slots[snapshots.currentSlot];
+  for (size_t r = 0; r < rings.size() && r < current.rings.size(); r++) {
+    const Body &body = heroBodies[rings[r].body];
+    GLdouble x = body.x * scale, y = body.y * scale, z = body.z * scale;
+    GLdouble reach = rings[r].reach * scale;
+    if (!cullSphere(frustum, cullingStats, x, y, z, reach)) {
+      continue;
     }
+    GLdouble dx = x - camera.x, dy = y - camera.y, dz = z - camera.z;
+    GLdouble nearest = sqrt(dx * dx + dy * dy + dz * dz) - reach;
+    drawRingBatch(ringBatches[r], rings[r], current.rings[r], body.color, x,
+                  y, z, scale, ringParticleSize(nearest) >= ringSpriteMinSize);
   }
 }
 
 // Function to draw all celestial bodies
 void drawBodies() {
-  drawBody(sun);
-  drawPlanets();
-  drawBody(moon);
+  ProfileScope scope(PROFILE_BODIES);
+  drawHeroBodies();
   drawBody(comet);
 }
 
 // Function to draw stars
 void drawStars() {
-  glBegin(GL_POINTS);
-  for (int i = 0; i < numberOfStars; i++) {
-    glColor3f(stars[i].brightness, stars[i].brightness, stars[i].brightness);
-    glVertex3f(stars[i].pos.x + camera.x, stars[i].pos.y + camera.y,
-               stars[i].pos.z + camera.z);
-  }
-  glEnd();
+  ProfileScope scope(PROFILE_STARS);
+  drawStarField(starField, camera);
 }
 
-// Function to draw a grid in the X-Z plane
+// Function to draw a grid in the X-Z plane, around the camera and within the
+// render distance
 void drawXZPlaneGrid() {
+  ProfileScope scope(PROFILE_GRID);
+  updateGridMesh(gridMesh, camera, gridSpacing, renderDistance, gridSize);
   glColor3f(0.2, 0.2, 0.2);
   glLineWidth(1.0f);
-  glBegin(GL_LINES);
-  for (int i = -gridSize; i <= gridSize; i += gridSpacing) {
-    glVertex3f(i, 0, -gridSize);
-    glVertex3f(i, 0, gridSize);
-    glVertex3f(-gridSize, 0, i);
-    glVertex3f(gridSize, 0, i);
-  };
-  glEnd();
+  drawGridMesh(gridMesh);
+}
+
+// Function to check if the Bezier curve may be visible, from the sphere
+// around its reference points
+bool bezierCurveVisible() {
+  return cullSphere(frustum, cullingStats, cometPath.center.x,
+                    cometPath.center.y, cometPath.center.z, cometPath.radius);
 }
 
 // Function to draw the Bezier curve
 void drawBezierCurve() {
   glColor3f(1.0f, 0.5f, 0.0f);
   glLineWidth(4.0f);
-  glBegin(GL_LINE_STRIP);
-  for (float t = 0; t <= 1; t = t + 0.01) {
-    Px = calculateBezierPoint('x', t);
-    Py = calculateBezierPoint('y', t);
-    Pz = calculateBezierPoint('z', t);
-    glVertex3d(Px, Py, Pz);
-  }
-  glEnd();
+  drawPathCurve(cometPathMesh);
 }
 
 // Function to draw the reference points of the Bezier curve
 void drawBezierRefPoints() {
   glColor3f(0.5f, 0.0f, 0.5f);
   glLineWidth(4.0f);
-  glBegin(GL_LINE_STRIP);
-  glVertex3i(Bx[0], By[0], Bz[0]);
-  glVertex3i(Bx[1], By[1], Bz[1]);
-  glVertex3i(Bx[2], By[2], Bz[2]);
-  glVertex3i(Bx[3], By[3], Bz[3]);
-  glEnd();
+  drawPathControl(cometPathMesh);
 }
 
 // If requested, draw a line between the player and a given planet
 void drawFindPlanet() {
-  // Initialize an iterator to the beginning of the map
-  Body planet;
-  for (int i = 0; i < 8; i++) {
+  for (size_t i = 0; i < finderBodies.size(); i++) {
     if (findPlanet[i]) {
-      planet = planets.at(planetsNames[i]);
+      const Body &planet = heroBodies[finderBodies[i]];
+      Coordinates start{camera.x, camera.y - 10, camera.z};
+      Coordinates end{GLfloat(planet.x * scale), GLfloat(planet.y * scale),
+                      GLfloat(planet.z * scale)};
+      if (!cullSegment(frustum, cullingStats, start, end)) {
+        continue;
+      }
       glColor3f(planet.color.r, planet.color.g, planet.color.b);
       glLineWidth(2.0f);
       glBegin(GL_LINE_STRIP);
       glVertex3i(camera.x, camera.y - 10, camera.z);
-      glVertex3i(planet.x * scale, 0, planet.z * scale);
+      glVertex3i(planet.x * scale, planet.y * scale, planet.z * scale);
       glEnd();
     }
   }
 }
 
-// Function to render the entire scene, including stars, celestial bodies, and
+// Function to draw the entire scene, including stars, celestial bodies, and
 // grid
-void renderScene(void) {
+void drawScene() {
+  ProfileScope scope(PROFILE_FRAME);
+  updateRenderedBodies();
   glViewport(0, 0, width, height);
 
+  // Objects outside the visible volume are skipped before any OpenGL call
+  cullingStats = CullingStats();
+  buildFrustum(frustum, camera, lookAtHim, fov, fAspect, 0.1, renderDistance);
+
   // Draw the stars before all other things and clearing the depth buffer, so
   // the stars are behind everything
   glClear(GL_COLOR_BUFFER_BIT);
@@ -274,26 +367,73 @@ void renderScene(void) {
   if (showGrid) {
     drawXZPlaneGrid();
   }
+  if (showTrails) {
+    ProfileScope trailsScope(PROFILE_TRAILS);
+    drawOrbitTrails(orbitTrails);
+  }
 
   // Enable the light just for the bodies
   glEnable(GL_LIGHTING);
   drawBodies();
   glDisable(GL_LIGHTING);
+  if (cullSphere(frustum, cullingStats, smallBodies.center[0],
+                 smallBodies.center[1], smallBodies.center[2],
+                 smallBodies.radius)) {
+    ProfileScope smallBodiesScope(PROFILE_SMALL_BODIES);
+    drawBodyBatch(smallBodies);
+  }
+  if (!rings.empty()) {
+    ProfileScope ringsScope(PROFILE_RINGS);
+    drawRings();
+  }
 
+  ProfileScope linesScope(PROFILE_LINES);
   drawFindPlanet();
 
-  if (showBezierCurve) {
+  if (showBezierCurve && bezierCurveVisible()) {
     drawBezierCurve();
     drawBezierRefPoints();
   }
+  recordCount(profiler, PROFILE_DRAWN, cullingStats.drawn);
+  recordCount(profiler, PROFILE_CULLED, cullingStats.culled);
+}
+
+// Function to render the scene in the window
+void renderScene(void) {
+  drawScene();
+  if (showProfilerHud) {
+    drawProfilerHud(profiler, width, height);
+  }
 
+  ProfileScope scope(PROFILE_PRESENT);
   glutSwapBuffers();
 }
 
+// Function to create the orbit trails of the first bodies, colored as they
+// are drawn
+void createTrails() {
+  size_t count = options.trailBodies > 0 ? options.trailBodies : heroBodyCount;
+  count = min(count, bodySystem.count);
+  vector<Color> colors(count, smallBodies.color);
+  for (const Body &body : heroBodies) {
+    if (body.systemIndex >= 0 && (size_t)body.systemIndex < count) {
+      colors[body.systemIndex] = body.color;
+    }
+  }
+  createOrbitTrails(orbitTrails, colors, options.trailLength,
+                    options.trailDecimation);
+}
+
 // Initialize OpenGL settings
 void initialize(void) {
+  // The light comes from the first body of the scenario
   GLfloat diffuseLight[4] = {1, 1, 1, 1};
-  GLfloat lightPosition[4] = {sun.x, 0, sun.z, 1.0};
+  GLfloat lightPosition[4] = {0, 0, 0, 1.0};
+  if (!heroBodies.empty()) {
+    lightPosition[0] = heroBodies[0].x * scale;
+    lightPosition[1] = heroBodies[0].y * scale;
+    lightPosition[2] = heroBodies[0].z * scale;
+  }
 
   // Material shininess
   GLfloat specular[4] = {1.0, 1.0, 1.0, 1.0};
@@ -327,6 +467,15 @@ void initialize(void) {
 
   glEnable(GL_DEPTH_TEST);                            // Turning on zBuffer
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Applying zBuffer
+
+  // The unit spheres are scaled uniformly, which only requires rescaling
+  // their normals
+  glEnable(GL_RESCALE_NORMAL);
+
+  uploadStarField(starField, stars);
+  uploadPathMesh(cometPathMesh, cometPath);
+  createTrails();
+  buildSphereMesh(sphereMesh);
 }
 
 // Set up the viewing parameters
@@ -401,6 +550,15 @@ void updateCamera(bool sidesOrientation, int way) {
   lookAtHim.z += deltaZ;
 }
 
+// Point the camera along its yaw and pitch
+void updateLookAt() {
+  lookAtHim.x = camera.x + cos(degreesToRadians(cameraYaw)) *
+                               cos(degreesToRadians(cameraPitch));
+  lookAtHim.y = camera.y + sin(degreesToRadians(cameraPitch));
+  lookAtHim.z = camera.z + sin(degreesToRadians(cameraYaw)) *
+                               cos(degreesToRadians(cameraPitch));
+}
+
 // Handle mouse movement to control the camera
 void handleMouseMovement(int x, int y) {
   if (x > width - 200 || y > height - 200 || x < 200 || y < 200) {
@@ -421,11 +579,7 @@ void handleMouseMovement(int x, int y) {
   else if (cameraPitch <= -90)
     cameraPitch = -89.9;
 
-  lookAtHim.x = camera.x + cos(degreesToRadians(cameraYaw)) *
-                               cos(degreesToRadians(cameraPitch));
-  lookAtHim.y = camera.y + sin(degreesToRadians(cameraPitch));
-  lookAtHim.z = camera.z + sin(degreesToRadians(cameraYaw)) *
-                               cos(degreesToRadians(cameraPitch));
+  updateLookAt();
 
   specifyViewingParameters();
   glutPostRedisplay();
@@ -477,7 +631,7 @@ void checkFindPlanet(char c) {
   int num;
   if (isValidNumber(c)) {
     num = (c - '0') - 1;
-    findPlanet[num] = !findPlanet[num];
+    findPlanet[num] = !findPlanet[num] && (size_t)num < finderBodies.size();
   }
 }
 
@@ -509,6 +663,18 @@ void handleKeyboard(unsigned char key, int x, int y) {
   case 'g':
     showGrid = !showGrid;
     break;
+  case 't':
+    showTrails = !showTrails;
+    break;
+  case 'k':
+    // Saved by the physics thread, which owns the bodies
+    checkpointRequested = true;
+    break;
+  case 'p':
+    // The sections are only timed while they are shown or exported
+    showProfilerHud = !showProfilerHud;
+    profiler.enabled = showProfilerHud || !options.profilePath.empty();
+    break;
   default:
     checkFindPlanet(key);
     break;
@@ -522,31 +688,167 @@ void handleKeyboardUp(unsigned char key, int x, int y) {
   }
 }
 
+// Function to advance the particles of the rings to the time of a snapshot,
+// pulled by their bodies and moons where the snapshot has them, and copy
+// their positions to it. A ring whose steps first fall behind is reported
+void publishRings(Snapshot &snapshot) {
+  ProfileScope scope(PROFILE_RING_STEPS);
+  snapshot.rings.resize(rings.size());
+  for (size_t r = 0; r < rings.size(); r++) {
+    RingParticles &ring = rings[r];
+    size_t body = heroBodies[ring.body].systemIndex;
+    for (RingMoon &moon : ring.moons) {
+      size_t index = heroBodies[moon.body].systemIndex;
+      if (body < snapshot.x.size() && index < snapshot.x.size()) {
+        moon.x = snapshot.x[index] - snapshot.x[body];
+        moon.y = snapshot.y[index] - snapshot.y[body];
+        moon.z = snapshot.z[index] - snapshot.z[body];
+      }
+    }
+
+    double skipped = ring.skipped;
+    advanceRingParticles(ring, snapshot.time, threadPool);
+    if (skipped == 0 && ring.skipped > 0) {
+      cerr << "The ring of " << scenario.names[ring.body]
+           << " cannot keep up with the simulation, so its particles skip "
+              "the time their steps do not cover."
+           << endl;
+    }
+    snapshot.rings[r].assign(ring.positions.begin(), ring.positions.end());
+  }
+}
+
+// Function to publish the current state of the bodies for the renderer
+void publishBodies() {
+  Snapshot &snapshot = snapshotToWrite(snapshots);
+  {
+    ProfileScope scope(PROFILE_PUBLISH);
+    snapshot.time = integrator.time;
+    snapshot.x.assign(bodySystem.x.begin(), bodySystem.x.end());
+    snapshot.y.assign(bodySystem.y.begin(), bodySystem.y.end());
+    snapshot.z.assign(bodySystem.z.begin(), bodySystem.z.end());
+    // Merged bodies move others to new indices, which the trails follow
+    if (integrator.collisions.enabled) {
+      snapshot.ids.assign(bodySystem.ids.begin(), bodySystem.ids.end());
+    }
+  }
+  publishRings(snapshot);
+  publishSnapshot(snapshots);
+}
+
+// Function to record the current state of the bodies, if a trajectory file
+// was given
+void recordBodies(const BodySystem &system) {
+  if (recorder.file != nullptr) {
+    recordTrajectoryFrame(recorder, system, integrator.time);
+  }
+}
+
+// Function to publish the decoded frame of the replay for the renderer
+void publishReplay() {
+  Snapshot &snapshot = snapshotToWrite(snapshots);
+  {
+    ProfileScope scope(PROFILE_PUBLISH);
+    snapshot.time = trajectoryTime(replay);
+    snapshot.ids.clear();
+    snapshot.x.resize(replay.count);
+    snapshot.y.resize(replay.count);
+    snapshot.z.resize(replay.count);
+    for (size_t i = 0; i < replay.count; i++) {
+      snapshot.x[i] = replay.px[i] * replay.quantum;
+      snapshot.y[i] = replay.py[i] * replay.quantum;
+      snapshot.z[i] = replay.pz[i] * replay.quantum;
+    }
+  }
+  publishRings(snapshot);
+  publishSnapshot(snapshots);
+}
+
+// Move through the recorded history instead of integrating, which is how the
+// simulation goes back in time while it is recording. The live state is left
+// untouched, and the integration continues from it once the replay catches
+// up. Returns false if there is no history to replay
+bool replayTick() {
+  if (!replaying) {
+    waitForTrajectoryWriter(recorder);
+    if (!openTrajectoryReader(replay, recorder)) {
+      return false;
+    }
+    replaying = true;
+    replayTime = integrator.time;
+  }
+
+  replayTime += (double)simulationSpeed * simulationTimePrecision;
+  if (replayTime >= integrator.time) {
+    closeTrajectoryReader(replay);
+    replaying = false;
+    publishBodies();
+    return true;
+  }
+  // The history starts at the first recorded frame
+  replayTime = max(replayTime, replay.index.front().time);
+  if (seekTrajectoryTime(replay, replayTime)) {
+    publishReplay();
+  }
+  return true;
+}
+
 // Update the simulation state for a time step
 void simulationTick() {
-  GLfloat ax, az;
-  int absSimulationSpeed = abs(simulationSpeed);
-  // timeWay: -1 (backwards in time) or 1 (forwards in time)
-  int timeWay = absSimulationSpeed / simulationSpeed;
+  ProfileScope scope(PROFILE_TICK);
+  advance(integrator, gravitySolver, bodySystem, threadPool,
+          (double)simulationSpeed * simulationTimePrecision);
+}
 
-  for (int t = 0; t < absSimulationSpeed; t++) {
-    rotateBody(sun, timeWay);
-    updateComet(comet, timeWay);
+// Main loop of the physics thread, which runs a tick every deltaT
+// milliseconds whatever the frame rate is
+void physicsLoop() {
+  const chrono::milliseconds tickInterval(deltaT);
+  auto nextTick = chrono::steady_clock::now();
+
+  while (physicsRunning) {
+    if (simulationSpeed != 0 && !simulationPaused &&
+        !(recorder.file != nullptr && (replaying || simulationSpeed < 0) &&
+          replayTick())) {
+      simulationTick();
+      recordBodies(bodySystem);
+      publishBodies();
+    }
+    if (checkpointRequested.exchange(false)) {
+      startCheckpointWrite(checkpointWriter,
+                           options.checkpointPath.empty()
+                               ? defaultCheckpointPath
+                               : options.checkpointPath,
+                           bodySystem, integrator);
+    }
 
-    for (auto &x : planets) {
-      ax = 0;
-      az = 0;
-      calculateGravity(x.second, sun, ax, az);
-      updateBody(x.second, ax, az, timeWay, simulationTimePrecision);
+    nextTick += tickInterval;
+    auto now = chrono::steady_clock::now();
+    if (nextTick < now) {
+      // Heavy ticks do not pile up: the simulation just runs slower
+      nextTick = now;
     }
+    this_thread::sleep_until(nextTick);
+  }
+}
 
-    ax = 0;
-    az = 0;
+// Start the physics thread from the current state of the bodies
+void startPhysicsThread() {
+  recordBodies(bodySystem);
+  publishBodies();
+  physicsRunning = true;
+  physicsThread = thread(physicsLoop);
+}
 
-    calculateGravity(moon, planets.at("Earth"), ax, az);
-    calculateGravity(moon, sun, ax, az);
-    updateBody(moon, ax, az, timeWay, simulationTimePrecision);
+// Stop the physics thread, which must be done before the program exits
+void stopPhysicsThread() {
+  physicsRunning = false;
+  if (physicsThread.joinable()) {
+    physicsThread.join();
   }
+  finishCheckpointWrite(checkpointWriter);
+  closeTrajectoryReader(replay);
+  stopTrajectoryRecorder(recorder);
 }
 
 void updateGridAndRenderDistance() {
@@ -597,38 +899,21 @@ void updateMovement() {
   }
 }
 
-// Timer function to update the simulation and rendering
+// Timer function to update the camera and request a new frame
 void timer(int _ = 0) {
   updateMovement();
-  if (simulationSpeed != 0 && !simulationPaused) {
-    simulationTick();
-  }
-
   specifyViewingParameters();
   glutPostRedisplay();
   glutTimerFunc(deltaT, timer, _);
 }
 
-// Initialize stars and celestial bodies
-void initStars() {
-  int yaw, pitch;
-  GLfloat brightness;
-  for (int i = 0; i < numberOfStars; i++) {
-    yaw = rand();
-    pitch = rand();
-    brightness = rand() / GLfloat(RAND_MAX) - 0.3;
-    stars[i].pos.x = cos(degreesToRadians(yaw)) * cos(degreesToRadians(pitch));
-    stars[i].pos.y = sin(degreesToRadians(pitch));
-    stars[i].pos.z = sin(degreesToRadians(yaw)) * cos(degreesToRadians(pitch));
-    stars[i].brightness = abs(brightness);
-    // multiple retries to reduce stars concentration in the poles
-    for (int j = 1; j < 100; j += j) {
-      if (stars[i].pos.y > j / 100.0 | stars[i].pos.y < -j / 100.0) {
-        pitch = rand();
-        stars[i].pos.y = sin(degreesToRadians(pitch));
-      }
-    }
+// Initialize the stars, from the catalogue if one was given
+bool initStars() {
+  if (!options.starCatalogue.empty()) {
+    return loadStarCatalogue(options.starCatalogue, stars, threadPool);
   }
+  generateStars(stars, options.stars, options.seed, threadPool);
+  return true;
 }
 
 // Function to set a new color
@@ -642,15 +927,17 @@ Color setColor(GLfloat cr, GLfloat cg, GLfloat cb) {
 }
 
 // Function to create a complete celestial body
-Body setBody(GLfloat mass, GLfloat x, GLfloat z, GLfloat vx, GLfloat vz,
-             GLfloat velocity, GLfloat rotatedAngle,
+Body setBody(GLdouble mass, GLdouble x, GLdouble y, GLdouble z, GLdouble vx,
+             GLdouble vy, GLdouble vz, GLfloat velocity, GLfloat rotatedAngle,
              GLfloat ownAxisRotationVelocity, Color color,
              GLfloat simulatedSize) {
   Body body;
   body.mass = mass;
   body.x = x;
+  body.y = y;
   body.z = z;
   body.vx = vx;
+  body.vy = vy;
   body.vz = vz;
   body.velocity = velocity;
   body.rotatedAngle = rotatedAngle;
@@ -659,44 +946,694 @@ Body setBody(GLfloat mass, GLfloat x, GLfloat z, GLfloat vx, GLfloat vz,
   body.color.g = color.g;
   body.color.b = color.b;
   body.simulatedSize = simulatedSize;
+  body.systemIndex = -1;
 
   return body;
 }
 
-// Set up properties of all celestial bodies
-void setBodies() {
-  // mass, x, z, vx, vz, velocity, rotatedAngle, ownAxisRotationVelocity, color,
-  // simulatedSize
-  sun = setBody(1.989e30, 0, 0, 0, 0, 0, 0, 0.004, setColor(1, 0.7, 0.0), 500);
-
-  planets.insert({"Mercury", setBody(3.3011e23, 57.9e9, 0, 0, 47.87e3, 0, 0,
-                                     0.1, setColor(0.8, 0.8, 0.8), 8)});
-  planets.insert({"Venus", setBody(4.8675e24, 108.2e9, 0, 0, 35.02e3, 0, 0, 0.1,
-                                   setColor(0.9, 0.8, 0.6), 10)});
-  planets.insert({"Earth", setBody(5.972e24, 147.1e9, 0, 0, 29.78e3, 0, 0, 0.1,
-                                   setColor(0.0, 0.5, 0.3), 10)});
-  planets.insert({"Mars", setBody(6.4171e23, 227.9e9, 0, 0, 24.077e3, 0, 0, 0.1,
-                                  setColor(0.9, 0.2, 0.1), 9)});
-  planets.insert({"Jupiter", setBody(1.8982e27, 778.3e9, 0, 0, 13.07e3, 0, 0,
-                                     0.1, setColor(0.9, 0.6, 0.4), 200)});
-  planets.insert({"Saturn", setBody(5.6834e26, 1.42e12, 0, 0, 9.69e3, 0, 0, 0.1,
-                                    setColor(0.8, 0.7, 0.5), 150)});
-  planets.insert({"Uranus", setBody(8.6810e25, 2.87e12, 0, 0, 6.81e3, 0, 0, 0.1,
-                                    setColor(0.6, 0.8, 0.8), 100)});
-  planets.insert({"Neptune", setBody(1.02413e26, 4.5e12, 0, 0, 5.43e3, 0, 0,
-                                     0.1, setColor(0.1, 0.1, 0.9), 100)});
-
-  moon = setBody(7.347e22, 147e9 - 4e8, 0, 0, 29783 + 1030, 0, 0, 0.1,
-                 setColor(0.3, 0.3, 0.3), 1.5);
-  comet = setBody(0, Bx[0] / scale, Bz[0] / scale, 0, 0, 0.0001, 0, 0,
+// Function to create the drawn body of a named body of the scenario
+Body scenarioBody(size_t id) {
+  return setBody(scenario.mass[id], scenario.x[id], scenario.y[id],
+                 scenario.z[id], scenario.vx[id], scenario.vy[id],
+                 scenario.vz[id], 0, 0, scenario.spins[id],
+                 scenario.colors[id], scenario.sizes[id]);
+}
+
+// Function to fill the rings of the scenario with particles, each ring
+// pulled by its body and the heaviest named bodies orbiting it. The radii are
+// in drawn sizes of the body, so the particles orbit where the ring is drawn
+void createRings() {
+  rings.assign(scenario.rings.size(), RingParticles());
+  ringBatches.resize(scenario.rings.size());
+  for (size_t r = 0; r < scenario.rings.size(); r++) {
+    const ScenarioRing &ring = scenario.rings[r];
+    double size = scenario.sizes[ring.body] / scale;
+    size_t count =
+        options.ringParticles >= 0 ? options.ringParticles : ring.particles;
+    createRingParticles(rings[r], ring.body, scenario.mass[ring.body],
+                        ring.inner * size, ring.outer * size,
+                        ring.thickness * size, count, options.seed + r,
+                        integrator.time);
+
+    vector<size_t> moons;
+    for (size_t id = 0; id < heroBodies.size(); id++) {
+      if (scenario.parents[id] == ring.body) {
+        moons.push_back(id);
+      }
+    }
+    sort(moons.begin(), moons.end(), [](size_t a, size_t b) {
+      return scenario.mass[a] > scenario.mass[b];
+    });
+    moons.resize(min(moons.size(), ringMoons));
+    // A moon is as large as it is drawn
+    for (size_t id : moons) {
+      addRingMoon(rings[r], id, scenario.mass[id], scenario.sizes[id] / scale);
+    }
+  }
+}
+
+// Function to find which named bodies are drawn clear of their parents, from
+// their initial orbits in the scenario. The bodies whose parent is not drawn
+// one by one are left where they are
+void setDrawnLifts() {
+  resetDrawnLifts(drawnLifts, heroBodyCount);
+  for (size_t id = 0; id < heroBodies.size(); id++) {
+    int parent = scenario.parents[id];
+    int body = heroBodies[id].systemIndex;
+    if (parent < 0 || body < 0 || body >= (int)heroBodyCount ||
+        heroBodies[parent].systemIndex < 0) {
+      continue;
+    }
+    setDrawnLift(drawnLifts, body, heroBodies[parent].systemIndex,
+                 gravitationalConstant *
+                     (scenario.mass[id] + scenario.mass[parent]),
+                 scenario.x[id] - scenario.x[parent],
+                 scenario.y[id] - scenario.y[parent],
+                 scenario.z[id] - scenario.z[parent],
+                 scenario.vx[id] - scenario.vx[parent],
+                 scenario.vy[id] - scenario.vy[parent],
+                 scenario.vz[id] - scenario.vz[parent],
+                 scenario.sizes[id] + scenario.sizes[parent], scale);
+  }
+}
+
+// Set up the celestial bodies from the scenario file. The named bodies are
+// drawn one by one and the others are batched
+bool setBodies() {
+  if (!loadScenario(options.scenarioPath, scenario)) {
+    return false;
+  }
+  addScenarioBodies(bodySystem, scenario);
+  heroBodies.clear();
+  finderBodies.clear();
+  for (size_t id = 0; id < scenario.count && !scenario.names[id].empty();
+       id++) {
+    heroBodies.push_back(scenarioBody(id));
+    heroBodies.back().systemIndex = id;
+    // The keys find the bodies orbiting the first one, in their order
+    if (scenario.parents[id] == 0 && finderBodies.size() < finderKeys) {
+      finderBodies.push_back(id);
+    }
+  }
+  heroBodyCount = heroBodies.size();
+  setDrawnLifts();
+  createRings();
+
+  buildSplinePath(cometPath, cometPathControl);
+  // mass, x, y, z, vx, vy, vz, velocity, rotatedAngle,
+  // ownAxisRotationVelocity, color, simulatedSize
+  comet = setBody(0, cometPath.control[0].x / scale,
+                  cometPath.control[0].y / scale,
+                  cometPath.control[0].z / scale, 0, 0, 0, 0.0001, 0, 0,
                   setColor(0.6, 0.6, 0.6), 20);
 
-  initStars();
+  if (bodySystem.count > 0) {
+    addAsteroidBelt(bodySystem, 0, options.asteroids, options.seed);
+  }
+  removeNetMomentum(bodySystem);
+
+  return initStars();
+}
+
+// Replace the integrated bodies and the integrator by those of a checkpoint.
+// The drawn bodies follow the integrated ones of the same name, and the
+// leading named bodies are drawn one by one
+bool restoreBodies(const string &path) {
+  if (!loadCheckpoint(path, bodySystem, integrator)) {
+    return false;
+  }
+
+  for (size_t id = 0; id < heroBodies.size(); id++) {
+    heroBodies[id].systemIndex = findBody(bodySystem, scenario.names[id]);
+  }
+  heroBodyCount = 0;
+  while (heroBodyCount < bodySystem.count &&
+         !bodySystem.names[heroBodyCount].empty()) {
+    heroBodyCount++;
+  }
+  setDrawnLifts();
+  for (RingParticles &ring : rings) {
+    ring.time = integrator.time;
+  }
+  return true;
+}
+
+// Place the bodies given with --ephemeris on the orbits they now have around
+// their parents in the scenario, to follow them in closed form from now on.
+// The bodies without a parent move in a straight line
+bool setEphemeris(BodySystem &system) {
+  clearEphemeris(integrator.ephemeris, integrator.time);
+  integrator.accelerationsValid = false;
+  vector<size_t> ids;
+  for (const string &name : options.ephemerisBodies) {
+    auto named = find(scenario.names.begin(), scenario.names.end(), name);
+    if (name == "all") {
+      for (size_t id = 0; id < scenario.count; id++) {
+        if (!scenario.names[id].empty()) {
+          ids.push_back(id);
+        }
+      }
+    } else if (named != scenario.names.end()) {
+      ids.push_back(named - scenario.names.begin());
+    } else {
+      cerr << "Unknown body '" << name << "' in the ephemeris." << endl;
+      return false;
+    }
+  }
+  // Parents come before their children in the scenario
+  sort(ids.begin(), ids.end());
+  ids.erase(unique(ids.begin(), ids.end()), ids.end());
+
+  for (size_t id : ids) {
+    int body = findBody(system, scenario.names[id]);
+    int parent = scenario.parents[id] < 0
+                     ? -1
+                     : findBody(system, scenario.names[scenario.parents[id]]);
+    if (body < 0 || (scenario.parents[id] >= 0 && parent < 0)) {
+      cerr << "The bodies do not hold '" << scenario.names[id]
+           << "' or its parent." << endl;
+      return false;
+    }
+    if (!addEphemerisBody(integrator.ephemeris, system, body, parent)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Integrate a scenario without any window, reporting the final states and the
+// achieved throughput
+int runHeadless(const string &scenarioPath) {
+  if (!loadScenario(scenarioPath, scenario)) {
+    return EXIT_FAILURE;
+  }
+
+  BodySystem system;
+  size_t scenarioBodies = scenario.count;
+  if (!options.restorePath.empty()) {
+    // The checkpoint holds the bodies and the step, the scenario only
+    // gives the horizon
+    if (!loadCheckpoint(options.restorePath, system, integrator)) {
+      return EXIT_FAILURE;
+    }
+    scenarioBodies = min(scenarioBodies, system.count);
+    if (options.timestep > 0) {
+      integrator.timestep = options.timestep;
+    }
+  } else {
+    addScenarioBodies(system, scenario);
+    if (options.asteroids > 0 && scenarioBodies > 0) {
+      addAsteroidBelt(system, 0, options.asteroids, options.seed);
+    }
+    integrator.timestep =
+        options.timestep > 0 ? options.timestep : scenario.timestep;
+  }
+  if (!setEphemeris(system)) {
+    return EXIT_FAILURE;
+  }
+  long restoredEvaluations = integrator.forceEvaluations;
+  long restoredSteps = integrator.steps;
+
+  if (!options.recordPath.empty() &&
+      !startTrajectoryRecorder(recorder, options.recordPath, system,
+                               options.recordQuantum, trajectorySlots)) {
+    return EXIT_FAILURE;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (recorder.file != nullptr) {
+    // Every step is recorded
+    recordBodies(system);
+    for (double remaining = scenario.horizon; remaining > 0;) {
+      double duration = min(integrator.timestep, remaining);
+      ProfileScope scope(PROFILE_TICK);
+      advance(integrator, gravitySolver, system, threadPool, duration);
+      recordBodies(system);
+      remaining -= duration;
+    }
+  } else {
+    ProfileScope scope(PROFILE_TICK);
+    advance(integrator, gravitySolver, system, threadPool, scenario.horizon);
+  }
+  bool recorded = stopTrajectoryRecorder(recorder);
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  cout.precision(10);
+  // Unnamed bodies of the scenario may have been merged
+  scenarioBodies = min(scenarioBodies, system.count);
+  for (size_t i = 0; i < scenarioBodies; i++) {
+    cout << "Body " << i << ": x=" << system.x[i] << " y=" << system.y[i]
+         << " z=" << system.z[i] << " vx=" << system.vx[i]
+         << " vy=" << system.vy[i] << " vz=" << system.vz[i] << endl;
+  }
+
+  double seconds = elapsed.count();
+  long evaluations = integrator.forceEvaluations - restoredEvaluations;
+  long steps = integrator.steps - restoredSteps;
+  cout.precision(6);
+  cout << "Integrated " << scenario.horizon << " s for " << system.count
+       << " bodies in " << steps << " steps with " << evaluations
+       << " force evaluations in " << seconds << " s";
+  if (seconds > 0 && steps > 0 && evaluations > 0) {
+    cout << " (" << steps / seconds << " steps/s, "
+         << evaluations / seconds << " evaluations/s, "
+         << seconds * 1e9 / ((double)evaluations * system.count)
+         << " ns/body-evaluation)";
+  }
+  cout << endl;
+  if (integrator.collisions.enabled) {
+    cout << "Merged " << integrator.collisions.merges << " bodies, "
+         << system.count << " left" << endl;
+  }
+
+  if (!options.checkpointPath.empty() &&
+      !saveCheckpoint(options.checkpointPath, system, integrator)) {
+    return EXIT_FAILURE;
+  }
+  return recorded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Move the camera to a key of a scripted path
+void placeCamera(const CameraKey &key) {
+  camera = key.position;
+  cameraYaw = key.yaw;
+  cameraPitch = max(-89.9f, min(89.9f, key.pitch));
+  updateLookAt();
+
+  // The grid adapts by one level per call, which may not be enough for the
+  // jumps of a path
+  for (int i = 0; i < 32; i++) {
+    int previousSpacing = gridSpacing;
+    updateGridAndRenderDistance();
+    if (gridSpacing == previousSpacing) {
+      break;
+    }
+  }
+}
+
+// Copy the oldest pending frame to the frame writer
+void writePendingFrame(PixelReadback &readback, FrameWriter &writer,
+                       long frame) {
+  ProfileScope scope(PROFILE_PRESENT);
+  unsigned char *pixels = acquireFrame(writer);
+  collectReadback(readback, pixels);
+  submitFrame(writer, frame);
+}
+
+// Render frames without any window, following the camera path if one was
+// given, and stream them to the frame writer. The physics steps of a frame and
+// the writing of the previous ones overlap with the readback of its pixels
+int runOffscreen() {
+  vector<CameraKey> cameraPath;
+  if (!options.cameraPath.empty() &&
+      !loadCameraPath(options.cameraPath, cameraPath)) {
+    return EXIT_FAILURE;
+  }
+
+  if (!setBodies() ||
+      (!options.restorePath.empty() && !restoreBodies(options.restorePath)) ||
+      !setEphemeris(bodySystem)) {
+    return EXIT_FAILURE;
+  }
+  OffscreenContext offscreen;
+  if (!createOffscreenContext(offscreen, options.frameWidth,
+                              options.frameHeight)) {
+    destroyOffscreenContext(offscreen);
+    return EXIT_FAILURE;
+  }
+  FrameWriter writer;
+  if (!startFrameWriter(writer, options.frameWidth, options.frameHeight,
+                        options.frameOutput, frameWriterSlots)) {
+    destroyOffscreenContext(offscreen);
+    return EXIT_FAILURE;
+  }
+
+  resizeWindow(options.frameWidth, options.frameHeight);
+  initialize();
+  PixelReadback readback;
+  createPixelReadback(readback, options.frameWidth, options.frameHeight);
+  if (!options.recordPath.empty() &&
+      !startTrajectoryRecorder(recorder, options.recordPath, bodySystem,
+                               options.recordQuantum, trajectorySlots)) {
+    destroyPixelReadback(readback);
+    stopFrameWriter(writer);
+    destroyOffscreenContext(offscreen);
+    return EXIT_FAILURE;
+  }
+  recordBodies(bodySystem);
+  publishBodies();
+
+  // Each frame covers as much simulated time as the window shows in the same
+  // real time
+  double ticksPerFrame = 1000 / (options.fps * deltaT);
+  auto start = chrono::steady_clock::now();
+
+  for (long frame = 0; frame < options.frames; frame++) {
+    if (!cameraPath.empty()) {
+      placeCamera(cameraAt(cameraPath, frame / options.fps));
+    }
+    specifyViewingParameters();
+    drawScene();
+    startReadback(readback);
+
+    {
+      ProfileScope scope(PROFILE_TICK);
+      advance(integrator, gravitySolver, bodySystem, threadPool,
+              simulationSpeed * simulationTimePrecision * ticksPerFrame);
+    }
+    recordBodies(bodySystem);
+    publishBodies();
+
+    if (frame > 0) {
+      writePendingFrame(readback, writer, frame - 1);
+    }
+  }
+  if (options.frames > 0) {
+    writePendingFrame(readback, writer, options.frames - 1);
+  }
+
+  bool written = stopFrameWriter(writer);
+  written = stopTrajectoryRecorder(recorder) && written;
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  destroyPixelReadback(readback);
+  destroyOffscreenContext(offscreen);
+
+  // The frames may be streamed to the standard output
+  ostream &report = options.frameOutput == "-" ? cerr : cout;
+  report << "Rendered " << options.frames << " frames of "
+         << options.frameWidth << "x" << options.frameHeight << " in "
+         << elapsed.count() << " s";
+  if (elapsed.count() > 0) {
+    report << " (" << options.frames / elapsed.count() << " frames/s)";
+  }
+  report << endl;
+
+  if (!options.checkpointPath.empty()) {
+    written = saveCheckpoint(options.checkpointPath, bodySystem, integrator) &&
+              written;
+  }
+  return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Report the samples of the profiler when the program exits: to the file
+// given in the command line, if any, and as a summary without a window
+void writeProfile() {
+  if (!options.profilePath.empty()) {
+    writeProfileCsv(profiler, options.profilePath);
+  }
+  if (options.profile && (options.headless || options.offscreen)) {
+    // The frames may be streamed to the standard output
+    printProfileSummary(profiler, cerr);
+  }
+}
+
+// Benchmark one leapfrog step of a star and a seeded belt of asteroids around
+// it, with the given number of bodies in total
+BenchmarkResult benchmarkStep(SolverKind kind, const string &name,
+                              size_t count) {
+  BodySystem system;
+  addBody(system, "", 1.989e30, 0, 0, 0, 0, 0, 0);
+  addAsteroidBelt(system, 0, count - 1, options.seed);
+
+  GravitySolver solver;
+  solver.kind = kind;
+  solver.theta = options.theta;
+  Integrator stepper;
+  stepper.kind = LEAPFROG;
+  stepper.timestep = simulationTimePrecision;
+
+  return measure(name, count, [&]() {
+    advance(stepper, solver, system, threadPool, stepper.timestep);
+  });
+}
+
+// Benchmark placing a star and a seeded belt of asteroids around it on their
+// orbits, with the given number of bodies in total
+BenchmarkResult benchmarkEphemeris(size_t count) {
+  BodySystem system;
+  addBody(system, "", 1.989e30, 0, 0, 0, 0, 0, 0);
+  addAsteroidBelt(system, 0, count - 1, options.seed);
+
+  GravitySolver solver;
+  Integrator stepper;
+  stepper.timestep = simulationTimePrecision;
+  addEphemerisBody(stepper.ephemeris, system, 0, -1);
+  for (size_t i = 1; i < count; i++) {
+    addEphemerisBody(stepper.ephemeris, system, i, 0);
+  }
+
+  return measure("place ephemeris", count, [&]() {
+    advance(stepper, solver, system, threadPool, stepper.timestep);
+  });
+}
+
+// Benchmark the search for colliding bodies in a star and a seeded belt of
+// asteroids around it, with the given number of bodies in total
+BenchmarkResult benchmarkCollisions(size_t count) {
+  BodySystem system;
+  addBody(system, "", 1.989e30, 0, 0, 0, 0, 0, 0);
+  addAsteroidBelt(system, 0, count - 1, options.seed);
+  Collisions collisions;
+
+  return measure("find collisions", count, [&]() {
+    resolveCollisions(collisions, system, simulationTimePrecision,
+                      threadPool);
+  });
+}
+
+// Benchmark advancing a ring of the given number of particles by one step,
+// around a body as heavy as Saturn and pulled by a moon as heavy as Mimas
+BenchmarkResult benchmarkRing(size_t count) {
+  const double radius = 6.0268e7; // of Saturn, in meters
+  RingParticles ring;
+  createRingParticles(ring, 0, 5.6834e26, 1.2 * radius, 2.3 * radius, 1e4,
+                      count, options.seed, 0);
+  addRingMoon(ring, 1, 3.75e19, 2e5);
+  ring.moons[0].x = 1.855e8;
+
+  return measure("step ring", count, [&]() {
+    advanceRingParticles(ring, ring.time + ring.step, threadPool);
+  });
+}
+
+// Benchmark a drawing pass, waiting for OpenGL to finish it in every run
+template <typename Pass>
+BenchmarkResult benchmarkPass(const string &name, Pass pass) {
+  return measure(name, 1, [&]() {
+    pass();
+    glFinish();
+  });
+}
+
+// Run the benchmarks of the physics and rendering hot paths, printing a table
+// of their results and writing them to a CSV file if one was given. Every
+// input is seeded, so the results of two runs only differ by the speed of the
+// code and of the machine
+int runBenchmarks() {
+  vector<BenchmarkResult> results;
+  auto report = [&](const BenchmarkResult &result) {
+    printBenchmarkResult(result, cout);
+    results.push_back(result);
+  };
+  printBenchmarkHeader(cout);
+
+  for (long count : options.benchmarkSizes) {
+    if ((size_t)count <= directSumBenchmarkLimit) {
+      report(benchmarkStep(DIRECT_SUM, "step direct", count));
+    }
+    report(benchmarkStep(BARNES_HUT, "step barnes-hut", count));
+    report(benchmarkEphemeris(count));
+    report(benchmarkCollisions(count));
+    report(benchmarkRing(count));
+  }
+
+  buildSplinePath(cometPath, cometPathControl);
+  report(measure("path point", pathBenchmarkPoints, [&]() {
+    double sum = 0;
+    for (size_t i = 0; i < pathBenchmarkPoints; i++) {
+      Coordinates point =
+          splinePoint(cometPath, i / double(pathBenchmarkPoints));
+      sum += point.x + point.z;
+    }
+    // Keep the compiler from removing the evaluations
+    volatile double sink = sum;
+    (void)sink;
+  }));
+
+  report(measure("init stars", options.stars, [&]() {
+    generateStars(stars, options.stars, options.seed, threadPool);
+  }));
+
+  OffscreenContext offscreen;
+  if (createOffscreenContext(offscreen, options.frameWidth,
+                             options.frameHeight)) {
+    if (options.asteroids == 0) {
+      options.asteroids = benchmarkAsteroids;
+    }
+    if (!setBodies()) {
+      destroyOffscreenContext(offscreen);
+      return EXIT_FAILURE;
+    }
+    resizeWindow(options.frameWidth, options.frameHeight);
+    initialize();
+    publishBodies();
+    specifyViewingParameters();
+    drawScene();
+
+    report(benchmarkPass("draw stars", [&]() {
+      glClear(GL_COLOR_BUFFER_BIT);
+      drawStars();
+    }));
+    report(benchmarkPass("draw grid", [&]() { drawXZPlaneGrid(); }));
+    report(benchmarkPass("draw bodies", [&]() {
+      glEnable(GL_LIGHTING);
+      drawBodies();
+      glDisable(GL_LIGHTING);
+    }));
+    report(benchmarkPass("draw small bodies",
+                         [&]() { drawBodyBatch(smallBodies); }));
+    report(benchmarkPass("draw rings", [&]() {
+      for (size_t r = 0; r < rings.size(); r++) {
+        const Body &body = heroBodies[rings[r].body];
+        drawRingBatch(ringBatches[r], rings[r], rings[r].positions,
+                      body.color, body.x * scale, body.y * scale,
+                      body.z * scale, scale, true);
+      }
+    }));
+    report(benchmarkPass("draw lines", [&]() {
+      drawFindPlanet();
+      drawBezierCurve();
+      drawBezierRefPoints();
+    }));
+    report(benchmarkPass("frame", [&]() { drawScene(); }));
+  } else {
+    cerr << "Skipping the rendering benchmarks." << endl;
+  }
+  destroyOffscreenContext(offscreen);
+
+  if (options.benchmarkPath.empty()) {
+    return EXIT_SUCCESS;
+  }
+  ostringstream configuration;
+  configuration << "threads=" << workerCount(threadPool)
+                << ";theta=" << options.theta << ";seed=" << options.seed
+                << ";frame=" << options.frameWidth << "x"
+                << options.frameHeight << ";asteroids=" << options.asteroids;
+  return writeBenchmarkCsv(results, configuration.str(), options.benchmarkPath)
+             ? EXIT_SUCCESS
+             : EXIT_FAILURE;
+}
+
+// Compile the scenario file to its binary form, which loads without any
+// parsing
+int compileScenario() {
+  auto start = chrono::steady_clock::now();
+  if (!loadScenario(options.scenarioPath, scenario)) {
+    return EXIT_FAILURE;
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  if (!saveCompiledScenario(options.compiledScenarioPath, scenario)) {
+    return EXIT_FAILURE;
+  }
+  cout << "Compiled " << scenario.count << " bodies and "
+       << scenario.rings.size() << " rings of '" << options.scenarioPath
+       << "' (parsed in " << elapsed.count() << " s) to '"
+       << options.compiledScenarioPath << "'." << endl;
+  return EXIT_SUCCESS;
+}
+
+// Run an ensemble of perturbed copies of the scenario, writing the summary
+// of every member to a CSV file as the members finish
+int runEnsembleStudy() {
+  EnsembleSpec spec;
+  spec.seed = options.seed;
+  if (!loadScenario(options.scenarioPath, scenario) ||
+      !loadEnsembleSpec(options.ensemblePath, scenario, spec)) {
+    return EXIT_FAILURE;
+  }
+  if (options.integrator != LEAPFROG && options.integrator != YOSHIDA4) {
+    cerr << "An ensemble is integrated with the leapfrog or yoshida4 "
+            "integrators."
+         << endl;
+    return EXIT_FAILURE;
+  }
+
+  ofstream file;
+  if (options.ensembleCsv != "-") {
+    file.open(options.ensembleCsv);
+    if (!file.is_open()) {
+      cerr << "Could not create ensemble file '" << options.ensembleCsv
+           << "'." << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  ostream &out = options.ensembleCsv == "-" ? cout : file;
+  double timestep = options.timestep > 0 ? options.timestep : scenario.timestep;
+
+  auto start = chrono::steady_clock::now();
+  bool written = runEnsemble(scenario, spec, options.integrator, timestep,
+                             threadPool, out);
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  if (!written) {
+    cerr << "Could not write the ensemble results." << endl;
+    return EXIT_FAILURE;
+  }
+
+  // The results may be streamed to the standard output
+  ostream &report = options.ensembleCsv == "-" ? cerr : cout;
+  report << "Integrated " << spec.members << " members of " << scenario.count
+         << " bodies over " << scenario.horizon << " s in " << elapsed.count()
+         << " s";
+  if (elapsed.count() > 0) {
+    report << " (" << spec.members / elapsed.count() << " members/s)";
+  }
+  report << endl;
+  return EXIT_SUCCESS;
 }
 
 // Main function of the simulation
 int main(int argc, char **argv) {
-  setBodies();
+  if (!parseOptions(argc, argv, options)) {
+    return EXIT_FAILURE;
+  }
+  gravitySolver.kind = options.solver;
+  gravitySolver.theta = options.theta;
+  gravitySolver.softening = options.softening;
+  startThreadPool(threadPool, options.threads);
+  integrator.kind = options.integrator;
+  integrator.timestep =
+      options.timestep > 0 ? options.timestep : simulationTimePrecision;
+  integrator.accuracy = options.accuracy;
+  integrator.collisions.enabled = options.collisions;
+  profiler.enabled = options.profile;
+  showProfilerHud = options.profile;
+  // Registered first so it runs after the physics thread has stopped
+  atexit(writeProfile);
+  if (options.scenarioPath.empty()) {
+    options.scenarioPath =
+        options.headless ? defaultHeadlessScenarioPath : defaultScenarioPath;
+  }
+  if (!options.compiledScenarioPath.empty()) {
+    return compileScenario();
+  }
+  if (options.headless) {
+    return runHeadless(options.scenarioPath);
+  }
+  if (options.offscreen) {
+    return runOffscreen();
+  }
+  if (!options.ensemblePath.empty()) {
+    return runEnsembleStudy();
+  }
+  if (options.benchmark) {
+    return runBenchmarks();
+  }
+
+  if (!setBodies() ||
+      (!options.restorePath.empty() && !restoreBodies(options.restorePath)) ||
+      !setEphemeris(bodySystem)) {
+    return EXIT_FAILURE;
+  }
   glutInit(&argc, argv);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
   glutInitWindowPosition(0, 0);
@@ -714,6 +1651,13 @@ int main(int argc, char **argv) {
   glutSpecialFunc(handleSpecialKeys);
   glutPassiveMotionFunc(handleMouseMovement);
   initialize();
+  if (!options.recordPath.empty() &&
+      !startTrajectoryRecorder(recorder, options.recordPath, bodySystem,
+                               options.recordQuantum, trajectorySlots)) {
+    return EXIT_FAILURE;
+  }
+  startPhysicsThread();
+  atexit(stopPhysicsThread);
   glutMainLoop();
   return 0;
 }